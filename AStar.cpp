@@ -1,28 +1,113 @@
 #ifndef ASTAR_CPP
 #define ASTAR_CPP
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits>
-#include <map>
-#include <queue>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
 
 namespace AStar{
 	const double INF = std::numeric_limits<double>::max();
 	// Declarations
 	using idstate_t = unsigned long long int;
 	using idaction_t = unsigned long long int;
+	using idnode_t = unsigned int;
+	const idnode_t NONODE = std::numeric_limits<idnode_t>::max();
 	class AStarMetrics;
+	class AStarParameters;
+	class Budget;
+	class BucketQueue;
+	class OpenList;
+	class Priority;
 	template <typename T> class Node;
 	template <typename T> class Edge;
 	template <typename T> class NodeState;
+	template <typename T> class StateTable;
+	template <typename M> class MessageQueue;
+	template <typename K,unsigned int D> class IndexedHeap;
 	template <typename T> using NodeNeighbors = std::vector<Edge<T>>;
 	template <typename T> using Path = std::vector<std::pair<idaction_t,T>>;
 	template <typename T> double defaultHeuristic(const T& state);
-	template <typename T> Path<T> AStar(const T& initialState,bool (*goalFunction)(const T& state),double (*heuristicFunction)(const T& state)=&defaultHeuristic,AStarMetrics* metrics=0);
+	// Goal and heuristic functions may be any callable taking const T& (function pointers, lambdas, functors with their
+	// own data), they are template arguments so the search can inline them; they must be safe to call from several threads
+	// with HDA*
+	template <typename T,typename G> Path<T> AStar(const T& initialState,const G& goalFunction);
+	template <typename T,typename G,typename H> Path<T> AStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics=0,const AStarParameters* parameters=0);
+	template <typename T,typename G,typename H> Path<T> AnytimeAStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,void (*solutionFunction)(const Path<T>& path,double bound),AStarMetrics* metrics=0,const AStarParameters* parameters=0);
+	template <typename T,typename G,typename H> Path<T> GreedyBestFirst(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics=0,const AStarParameters* parameters=0);
+	template <typename T,typename G,typename H> Path<T> IDAStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics=0,const AStarParameters* parameters=0);
+	template <typename T,typename G,typename H> Path<T> HDAStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics=0,const AStarParameters* parameters=0);
+	template <typename T,typename G,typename H> Path<T> Search(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics=0,const AStarParameters* parameters=0);
+	
+	// Order among open nodes with the same priority
+	namespace TieBreaking {
+		const unsigned int LIFO = 0x0;
+		const unsigned int FIFO = 0x1;
+		const unsigned int LOWEST_H = 0x2;
+		const unsigned int HIGHEST_G = 0x3;
+		static const char* const names[] = {"LIFO","FIFO","lowest h","highest g"};
+	};
+	
+	// Search engine chosen by Search
+	namespace SearchStrategy {
+		const unsigned int ASTAR = 0x0;
+		const unsigned int ANYTIME = 0x1;
+		const unsigned int GREEDY = 0x2;
+		const unsigned int IDASTAR = 0x3;
+		const unsigned int HDASTAR = 0x4;
+		static const char* const names[] = {"A*","anytime A*","greedy best first","IDA*","HDA*"};
+	};
+	
+	// Reason a search stopped
+	namespace Termination {
+		const unsigned int NONE = 0x0;
+		const unsigned int SOLVED = 0x1;
+		const unsigned int EXHAUSTED = 0x2;
+		const unsigned int TIME_LIMIT = 0x3;
+		const unsigned int NODE_LIMIT = 0x4;
+		const unsigned int MEMORY_LIMIT = 0x5;
+		static const char* const names[] = {"none","solved","exhausted","time limit","node limit","memory limit"};
+	};
+	
+	// Resident memory of the process in bytes, 0 when it can't be measured
+	inline size_t residentMemory(){
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		if(GetProcessMemoryInfo(GetCurrentProcess(),&counters,sizeof(counters))){ return counters.WorkingSetSize; }
+#elif defined(__linux__)
+		std::ifstream statm("/proc/self/statm");
+		size_t pages, resident;
+		if(statm >> pages >> resident){ return resident*sysconf(_SC_PAGESIZE); }
+#endif
+		return 0;
+	}
+	
+	// Mixes the bits of a state identifier, sequential identifiers are common
+	inline size_t hashState(idstate_t key){
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		return key ^ (key >> 33);
+	}
+	
+	// States may free what their neighbors hold with a releaseNeighbors member, the depth first search calls it once it is done
+	// with the neighbors of a state; states without it keep their neighbors
+	template <typename T> inline auto releaseNeighbors(T& state,int) -> decltype(state.releaseNeighbors()){ return state.releaseNeighbors(); }
+	template <typename T> inline void releaseNeighbors(T&,long){}
 	
 	// Classes
 	template <typename T> class Node{
@@ -37,6 +122,7 @@ namespace AStar{
 			inline const T& getState(){ return state; }
 			inline idstate_t getIdentifier(){ return id; }
 			inline NodeNeighbors<T> getNeighbors(){ return state.getNeighbors(); };
+			inline void releaseNeighbors(){ AStar::releaseNeighbors(state,0); };
 	};
 	
 	template <typename T> class Edge{
@@ -52,15 +138,386 @@ namespace AStar{
 	template <typename T> class NodeState{
 		public:
 			T state;
-			NodeState<T>* previous;
+			idnode_t previous;
 			double realCost;
 			double hCost;
 			idaction_t action;
 			bool isNew;
 			bool visited;
 			bool path;
-			NodeState() : previous(0), realCost(INF), hCost(INF), isNew(true), visited(false),path(false) {};
-			NodeState(const T& state) : state(state), previous(0), realCost(0), hCost(INF), isNew(true), visited(false),path(true) {};
+			NodeState() : previous(NONODE), realCost(INF), hCost(INF), action(0), isNew(true), visited(false),path(false) {};
+			NodeState(const T& state) : state(state), previous(NONODE), realCost(0), hCost(INF), action(0), isNew(true), visited(false),path(true) {};
+	};
+	
+	// Open addressing (linear probing) table from state identifiers to nodes stored contiguously in an arena
+	// Nodes are never removed during a search, so a node index remains valid even when the arena grows
+	template <typename T> class StateTable{
+		protected:
+			class Slot{
+				public:
+					idstate_t key;
+					idnode_t node;
+					Slot() : key(0), node(NONODE) {};
+			};
+			std::vector<Slot> slots;
+			std::vector<NodeState<T>> nodes;
+			size_t mask;
+			static inline size_t hash(idstate_t key){ return hashState(key); }
+			void grow(){
+				std::vector<Slot> old(slots.size()<<1);
+				old.swap(slots);
+				mask = slots.size()-1;
+				for(const Slot &slot : old){
+					if(slot.node==NONODE){ continue; }
+					size_t pos = hash(slot.key) & mask;
+					while(slots[pos].node!=NONODE){ pos = (pos+1) & mask; }
+					slots[pos] = slot;
+				}
+			}
+		public:
+			StateTable(size_t capacity=1024) : slots(capacity), mask(capacity-1) {};
+			inline size_t size() const { return nodes.size(); }
+			inline NodeState<T>& operator[](idnode_t node){ return nodes[node]; }
+			// Returns the node of the state, creating a default one if the state is unknown
+			// Creating a node may reallocate the arena: references to other nodes must be requested again
+			idnode_t lookup(idstate_t key){
+				size_t pos = hash(key) & mask;
+				while(slots[pos].node!=NONODE){
+					if(slots[pos].key==key){ return slots[pos].node; }
+					pos = (pos+1) & mask;
+				}
+				idnode_t node = nodes.size();
+				slots[pos].key = key;
+				slots[pos].node = node;
+				nodes.emplace_back();
+				if((nodes.size()<<1) > slots.size()){ grow(); }
+				return node;
+			}
+			idnode_t insert(idstate_t key,const NodeState<T> &nodeState){
+				idnode_t node = lookup(key);
+				nodes[node] = nodeState;
+				return node;
+			}
+	};
+	
+	// Indexed D-ary min-heap of arena nodes: every open node has exactly one entry, whose key can be decreased in place
+	template <typename K,unsigned int D=4> class IndexedHeap{
+		protected:
+			class Entry{
+				public:
+					K key;
+					idnode_t node;
+			};
+			std::vector<Entry> heap;
+			std::vector<idnode_t> position;
+			inline void place(size_t pos,const Entry &entry){
+				heap[pos] = entry;
+				position[entry.node] = pos;
+			}
+			void siftUp(size_t pos){
+				Entry entry = heap[pos];
+				while(pos){
+					size_t parent = (pos-1)/D;
+					if(!(entry.key < heap[parent].key)){ break; }
+					place(pos,heap[parent]);
+					pos = parent;
+				}
+				place(pos,entry);
+			}
+			void siftDown(size_t pos){
+				Entry entry = heap[pos];
+				size_t size = heap.size();
+				while(true){
+					size_t first = pos*D+1;
+					if(first >= size){ break; }
+					size_t last = std::min(first+D,size);
+					size_t best = first;
+					for(size_t child = first+1; child < last; child++){
+						if(heap[child].key < heap[best].key){ best = child; }
+					}
+					if(!(heap[best].key < entry.key)){ break; }
+					place(pos,heap[best]);
+					pos = best;
+				}
+				place(pos,entry);
+			}
+		public:
+			inline bool empty() const { return heap.empty(); }
+			inline size_t size() const { return heap.size(); }
+			inline bool contains(idnode_t node) const { return node < position.size() && position[node] != NONODE; }
+			inline const K& topKey() const { return heap.front().key; }
+			inline idnode_t top() const { return heap.front().node; }
+			// Inserts the node or, when it is already in the heap, replaces its key with a lower one
+			void push(idnode_t node,const K &key){
+				if(node >= position.size()){ position.resize(std::max<size_t>(node+1,position.size()<<1),NONODE); }
+				if(position[node] != NONODE){
+					size_t pos = position[node];
+					if(!(key < heap[pos].key)){ return; }
+					heap[pos].key = key;
+					siftUp(pos);
+					return;
+				}
+				heap.push_back({key,node});
+				siftUp(heap.size()-1);
+			}
+			idnode_t pop(){
+				idnode_t node = heap.front().node;
+				position[node] = NONODE;
+				Entry last = heap.back();
+				heap.pop_back();
+				if(!heap.empty()){
+					heap.front() = last;
+					siftDown(0);
+				}
+				return node;
+			}
+	};
+	
+	// Dial's bucket queue over small non-negative integer priorities, with a second level of buckets for tie breaking
+	// Each bucket is an intrusive doubly linked list over node indices, so moving a node to a lower bucket is O(1)
+	// Levels and buckets are allocated up to the largest value pushed (below MAXBUCKETS each) and counted by allocated, a
+	// bucket takes 8 bytes and a level 40; OpenList bounds them by the number of nodes queued
+	class BucketQueue{
+		protected:
+			class Link{
+				public:
+					idnode_t previous;
+					idnode_t next;
+					unsigned int level;
+					unsigned int bucket;
+					Link() : previous(NONODE), next(NONODE), level(NOBUCKET), bucket(NOBUCKET) {};
+			};
+			class Bucket{
+				public:
+					idnode_t head;
+					idnode_t tail;
+					Bucket() : head(NONODE), tail(NONODE) {};
+			};
+			class Level{
+				public:
+					std::vector<Bucket> buckets;
+					size_t count;
+					unsigned int minimum;
+					Level() : count(0), minimum(0) {};
+			};
+			std::vector<Level> levels;
+			std::vector<Link> links;
+			size_t count;
+			size_t slots;
+			unsigned int minimum;
+			bool fifo;
+			void unlink(idnode_t node){
+				Link &link = links[node];
+				Level &level = levels[link.level];
+				Bucket &bucket = level.buckets[link.bucket];
+				if(link.previous != NONODE){ links[link.previous].next = link.next; }else{ bucket.head = link.next; }
+				if(link.next != NONODE){ links[link.next].previous = link.previous; }else{ bucket.tail = link.previous; }
+				link = Link();
+				level.count--;
+				count--;
+			}
+		public:
+			static const unsigned int NOBUCKET = std::numeric_limits<unsigned int>::max();
+			static const unsigned int MAXBUCKETS = 1<<16;
+			BucketQueue(bool fifo=false) : count(0), slots(0), minimum(0), fifo(fifo) {};
+			inline bool empty() const { return !count; }
+			inline size_t size() const { return count; }
+			// Levels and buckets allocated so far
+			inline size_t allocated() const { return slots; }
+			// Frees the levels, buckets and links once the queue is empty
+			void release(){
+				std::vector<Level>().swap(levels);
+				std::vector<Link>().swap(links);
+				slots = 0;
+				minimum = 0;
+			}
+			inline bool contains(idnode_t node) const { return node < links.size() && links[node].level != NOBUCKET; }
+			// Inserts the node or, when it is already queued, moves it to a lower (level, bucket) pair
+			void push(idnode_t node,unsigned int level,unsigned int bucket){
+				if(node >= links.size()){ links.resize(std::max<size_t>(node+1,links.size()<<1)); }
+				if(links[node].level != NOBUCKET){
+					if(level > links[node].level || (level == links[node].level && bucket >= links[node].bucket)){ return; }
+					unlink(node);
+				}
+				if(level >= levels.size()){
+					slots += level+1-levels.size();
+					levels.resize(level+1);
+				}
+				Level &l = levels[level];
+				if(bucket >= l.buckets.size()){
+					slots += bucket+1-l.buckets.size();
+					l.buckets.resize(bucket+1);
+				}
+				Bucket &b = l.buckets[bucket];
+				Link &link = links[node];
+				link.level = level;
+				link.bucket = bucket;
+				link.previous = b.tail;
+				if(b.tail != NONODE){ links[b.tail].next = node; }else{ b.head = node; }
+				b.tail = node;
+				l.minimum = l.count?std::min(l.minimum,bucket):bucket;
+				l.count++;
+				minimum = std::min(minimum,level);
+				count++;
+			}
+			idnode_t top(){
+				while(!levels[minimum].count){ minimum++; }
+				Level &level = levels[minimum];
+				while(level.buckets[level.minimum].head == NONODE){ level.minimum++; }
+				Bucket &bucket = level.buckets[level.minimum];
+				return fifo?bucket.head:bucket.tail;
+			}
+			idnode_t pop(){
+				idnode_t node = top();
+				unlink(node);
+				return node;
+			}
+	};
+	
+	// Heap key: f value first, then a tie value chosen by the tie breaking policy
+	class Priority{
+		public:
+			double f;
+			double tie;
+			inline bool operator<(const Priority &other) const { return f < other.f || (f == other.f && tie < other.tie); }
+	};
+	
+	// Frontier of the search: a bucket queue while every priority is a small non-negative integer
+	// The first fractional or large priority moves all open nodes into an indexed heap for the rest of the search, and so do
+	// priorities spread so wide that the buckets outnumber SPREAD times the open nodes past MAXBUCKETS: the queue then
+	// holds at most SPREAD*nodes + 3*MAXBUCKETS levels and buckets of up to 40 bytes (8 MB with few nodes queued), twice
+	// that with the spare capacity of their vectors
+	class OpenList{
+		protected:
+			BucketQueue buckets;
+			IndexedHeap<Priority> heap;
+			std::vector<Priority> keys;
+			unsigned int tieBreaking;
+			double order;
+			bool bucketed;
+			static inline bool isBucket(double value){ return value >= 0.0 && value < BucketQueue::MAXBUCKETS && value == (unsigned int)value; }
+			void migrate(){
+				while(!buckets.empty()){
+					idnode_t node = buckets.pop();
+					heap.push(node,keys[node]);
+				}
+				buckets.release();
+				std::vector<Priority>().swap(keys);
+				bucketed = false;
+			}
+		public:
+			static const size_t SPREAD = 4;
+			OpenList(bool useBuckets=true,unsigned int tieBreaking=TieBreaking::LIFO) : buckets(tieBreaking==TieBreaking::FIFO), tieBreaking(tieBreaking), order(0.0), bucketed(useBuckets) {};
+			inline bool empty() const { return bucketed?buckets.empty():heap.empty(); }
+			inline bool contains(idnode_t node) const { return bucketed?buckets.contains(node):heap.contains(node); }
+			inline bool isBucketed() const { return bucketed; }
+			void push(idnode_t node,double f,double g,double h){
+				Priority key{f,0.0};
+				double bucket = 0.0;
+				switch(tieBreaking){
+					case TieBreaking::LIFO: key.tie = -(++order); break;
+					case TieBreaking::FIFO: key.tie = ++order; break;
+					case TieBreaking::LOWEST_H: bucket = key.tie = h; break;
+					// For a fixed f the g value is highest when f-g is lowest, which keeps bucket indices non-negative
+					case TieBreaking::HIGHEST_G: key.tie = -g; bucket = f-g; break;
+				}
+				if(bucketed && !(isBucket(f) && isBucket(bucket))){ migrate(); }
+				if(!bucketed){
+					heap.push(node,key);
+					return;
+				}
+				if(node >= keys.size()){ keys.resize(std::max<size_t>(node+1,keys.size()<<1)); }
+				keys[node] = key;
+				buckets.push(node,(unsigned int)f,(unsigned int)bucket);
+				if(buckets.allocated() > BucketQueue::MAXBUCKETS && buckets.allocated() > SPREAD*buckets.size()){ migrate(); }
+			}
+			inline idnode_t top(){ return bucketed?buckets.top():heap.top(); }
+			inline idnode_t pop(){ return bucketed?buckets.pop():heap.pop(); }
+	};
+	
+	// Lock free multiple producer, single consumer queue (Vyukov): producers only exchange the head pointer
+	template <typename M> class MessageQueue{
+		protected:
+			class Link{
+				public:
+					std::atomic<Link*> next;
+					M message;
+					Link() : next(0) {};
+			};
+			std::atomic<Link*> head;
+			Link* tail;
+			Link stub;
+		public:
+			MessageQueue() : head(&stub), tail(&stub) {};
+			~MessageQueue(){
+				M message;
+				while(pop(message));
+				if(tail != &stub){ delete tail; }
+			}
+			void push(M &message){
+				Link* link = new Link();
+				link->message = std::move(message);
+				Link* previous = head.exchange(link,std::memory_order_acq_rel);
+				previous->next.store(link,std::memory_order_release);
+			}
+			// Only the consumer thread may pop
+			bool pop(M &message){
+				Link* next = tail->next.load(std::memory_order_acquire);
+				if(!next){ return false; }
+				message = std::move(next->message);
+				if(tail != &stub){ delete tail; }
+				tail = next;
+				return true;
+			}
+	};
+	
+	class AStarParameters{
+		public:
+			// Bucket queue: Use a bucket queue as frontier while priorities are integral (unit or small integer costs and heuristics)
+			// Tie breaking: Order among open nodes with the same f value (see TieBreaking)
+			// Weight: Factor applied to the heuristic, f = g + weight*h (the initial weight for the anytime search)
+			// Weight decrement: Amount the anytime search lowers the weight after each solution, until it reaches 1
+			// Strategy: Search engine used by Search (see SearchStrategy)
+			// Threads: Workers of the parallel search (0 uses every hardware thread)
+			// Exclusive expansion: Serialize the goal test and neighbor generation of the parallel search, for states that share mutable data
+			// Time limit: Milliseconds the search may run (0 for no limit)
+			// Node limit: Number of nodes the search may expand (0 for no limit)
+			// Memory limit: Resident memory in bytes the process may reach during the search (0 for no limit)
+			// Solution function: Called by the anytime search with the actions, cost and bound of every improved solution and
+			// the solution data, so Search can report them too (null for none)
+			unsigned int strategy;
+			unsigned int threads;
+			bool exclusiveExpansion;
+			bool bucketQueue;
+			unsigned int tieBreaking;
+			double weight;
+			double weightDecrement;
+			double timeLimit;
+			unsigned long long int nodeLimit;
+			size_t memoryLimit;
+			void (*solutionFunction)(const std::vector<idaction_t>& actions,double cost,double bound,void* data);
+			void* solutionData;
+			AStarParameters() : strategy(SearchStrategy::ASTAR), threads(0), exclusiveExpansion(false), bucketQueue(true), tieBreaking(TieBreaking::LOWEST_H), weight(1.0), weightDecrement(0.5), timeLimit(0.0), nodeLimit(0), memoryLimit(0), solutionFunction(0), solutionData(0) {};
+	};
+	
+	// Limits of a search, the clock and the resident memory are only sampled every SAMPLE expansions
+	class Budget{
+		protected:
+			const AStarParameters* parameters;
+			std::chrono::steady_clock::time_point start;
+			unsigned int samples;
+		public:
+			static const unsigned int SAMPLE = 256;
+			Budget(const AStarParameters* p) : parameters(p), start(std::chrono::steady_clock::now()), samples(0) {};
+			// Returns the limit reached after the given number of expansions, Termination::NONE while within the budget
+			unsigned int check(unsigned long long int expandedNodes){
+				if(parameters->nodeLimit && expandedNodes >= parameters->nodeLimit){ return Termination::NODE_LIMIT; }
+				if(++samples < SAMPLE){ return Termination::NONE; }
+				samples = 0;
+				if(parameters->timeLimit > 0.0 && std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count() >= parameters->timeLimit){ return Termination::TIME_LIMIT; }
+				if(parameters->memoryLimit && residentMemory() >= parameters->memoryLimit){ return Termination::MEMORY_LIMIT; }
+				return Termination::NONE;
+			}
 	};
 	
 	class AStarMetrics{
@@ -69,14 +526,56 @@ namespace AStar{
 			// Frontier nodes: Number of known different states
 			// Expanded nodes: Number of states that were expanded (their neighbors were requested)
 			// Visited nodes: Number of states evaluated (might have been repeated/excluded)
+			// Reopened nodes: Number of expanded states that were put back in the frontier after a cheaper path was found
+			// Decreased keys: Number of open states whose priority was lowered in place
+			// Evaluated nodes: Number of heuristic evaluations
+			// Saved evaluations: Number of generated states whose evaluation was deferred and never needed
+			// Solutions: Number of solutions found (the anytime search reports one per improvement)
+			// Bound: Suboptimality bound of the returned solution, relative to an admissible heuristic
+			// Thread expansions: Expanded nodes per worker of the parallel search
+			// Sent nodes: States sent by the parallel search to the worker that owns them, in sent messages (batches)
+			// Termination: Reason the search stopped (see Termination)
+			// Best heuristic: Lowest heuristic value reached, partial actions lead to that state when no solution is returned
 			unsigned int frontierNodes;
 			unsigned int expandedNodes;
 			unsigned int visitedNodes;
+			unsigned int reopenedNodes;
+			unsigned int decreasedKeys;
+			unsigned int evaluatedNodes;
+			unsigned int savedEvaluations;
+			unsigned int strategy;
+			bool bucketQueue;
+			unsigned int tieBreaking;
+			unsigned int solutions;
+			double bound;
+			std::vector<unsigned int> threadExpansions;
+			unsigned int sentNodes;
+			unsigned int sentMessages;
+			unsigned int termination;
+			double bestHeuristic;
+			std::vector<idaction_t> partialActions;
 			friend std::ostream& operator<<(std::ostream &out, AStarMetrics &mets){
+				out << "Search: " << SearchStrategy::names[mets.strategy] << std::endl;
+				out << "Termination: " << Termination::names[mets.termination] << std::endl;
 				out << "Time taken: " << std::setprecision(3) << (mets.timeTaken/1000.0) << " s" << std::endl;
 				out << "Frontier nodes: " << mets.frontierNodes << std::endl;
 				out << "Expanded nodes: " << mets.expandedNodes << std::endl;
-				return out << "Visited nodes: " << mets.visitedNodes << std::endl;
+				out << "Visited nodes: " << mets.visitedNodes << std::endl;
+				out << "Open list: " << (mets.bucketQueue?"buckets":"heap") << std::endl;
+				out << "Tie breaking: " << TieBreaking::names[mets.tieBreaking] << std::endl;
+				out << "Reopened nodes: " << mets.reopenedNodes << std::endl;
+				out << "Decreased keys: " << mets.decreasedKeys << std::endl;
+				out << "Evaluated nodes: " << mets.evaluatedNodes << std::endl;
+				out << "Saved evaluations: " << mets.savedEvaluations << std::endl;
+				out << "Solutions: " << mets.solutions << std::endl;
+				out << "Bound: " << mets.bound << std::endl;
+				out << "Best heuristic: " << mets.bestHeuristic << std::endl;
+				if(!mets.threadExpansions.empty()){
+					out << "Thread expansions:";
+					for(unsigned int expansions : mets.threadExpansions){ out << " " << expansions; }
+					out << std::endl << "Sent nodes: " << mets.sentNodes << " in " << mets.sentMessages << " messages" << std::endl;
+				}
+				return out;
 			}
 	};
 	
@@ -84,65 +583,705 @@ namespace AStar{
 		return 0.0;
 	}
 	
-	template <typename T> Path<T> AStar(const T& initialState,bool (*goalFunction)(const T& state),double (*heuristicFunction)(const T& state),AStarMetrics* metrics){
+	template <typename T,typename G> Path<T> AStar(const T& initialState,const G& goalFunction){
+		return AStar(initialState,goalFunction,&defaultHeuristic<T>);
+	}
+	
+	template <typename T> Path<T> buildPath(StateTable<T> &knownStates,idnode_t node){
+		Path<T> path;
+		for(; node != NONODE; node = knownStates[node].previous){
+			NodeState<T> &nodeState = knownStates[node];
+			nodeState.path = true;
+			path.push_back({nodeState.action,nodeState.state});
+		}
+		std::reverse(path.begin(),path.end());
+		return path;
+	}
+	
+	template <typename T> std::vector<idaction_t> buildActions(StateTable<T> &knownStates,idnode_t node){
+		std::vector<idaction_t> actions;
+		for(; node != NONODE && knownStates[node].previous != NONODE; node = knownStates[node].previous){ actions.push_back(knownStates[node].action); }
+		std::reverse(actions.begin(),actions.end());
+		return actions;
+	}
+	
+	template <typename T,typename G,typename H> Path<T> AStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics,const AStarParameters* parameters){
 		Path<T> solution;
-		std::priority_queue<Edge<T>> frontier;
-		std::map<idstate_t, NodeState<T>> knownStates;
+		AStarParameters defaultParameters;
+		if(!parameters){ parameters = &defaultParameters; }
+		double weight = parameters->weight;
+		OpenList frontier(parameters->bucketQueue,parameters->tieBreaking);
+		StateTable<T> knownStates;
 		unsigned int expandedNodes = 0;
 		unsigned int visitedNodes = 1;
+		unsigned int reopenedNodes = 0;
+		unsigned int decreasedKeys = 0;
+		unsigned int evaluatedNodes = 1;
+		unsigned int termination = Termination::NONE;
+		Budget budget(parameters);
 		Node<T> initialNode(initialState);
 		auto tStart = std::chrono::steady_clock::now();
-		frontier.push({initialNode,0.0});
-		knownStates.insert({initialNode.getIdentifier(),NodeState<T>(initialState)});
-		Node<T> current;
-		NodeState<T>* currentState;
+		idnode_t initial = knownStates.insert(initialNode.getIdentifier(),NodeState<T>(initialState));
+		double bestHeuristic = knownStates[initial].hCost = heuristicFunction(initialState);
+		idnode_t bestNode = initial;
+		knownStates[initial].isNew = false;
+		frontier.push(initial,weight*bestHeuristic,0.0,bestHeuristic);
+		idnode_t currentNode = NONODE;
 		bool goal = false;
 		while(!frontier.empty()){
-			current = frontier.top().state;
-			frontier.pop();
-			currentState = &knownStates[current.getIdentifier()];
-			if(goalFunction(current.getState())){
+			if((termination = budget.check(expandedNodes))){ break; }
+			currentNode = frontier.pop();
+			if(goalFunction(knownStates[currentNode].state)){
 				goal = true;
 				break;
 			}
-			if(currentState->visited){ continue; }
-			NodeNeighbors<T> neighbors = current.getNeighbors();
+			NodeNeighbors<T> neighbors = knownStates[currentNode].state.getNeighbors();
 			visitedNodes += neighbors.size();
 			expandedNodes++;
-			currentState->visited = true;
-			for(Edge<T> neighbor : neighbors){
-				NodeState<T> *neighborState = &knownStates[neighbor.state.getIdentifier()];
+			knownStates[currentNode].visited = true;
+			double currentCost = knownStates[currentNode].realCost;
+			for(Edge<T> &neighbor : neighbors){
+				idnode_t neighborNode = knownStates.lookup(neighbor.state.getIdentifier());
+				NodeState<T> *neighborState = &knownStates[neighborNode];
 				if(neighborState->isNew){
 					neighborState->hCost = heuristicFunction(neighborState->state = neighbor.state.getState());
 					neighborState->isNew = false;
+					evaluatedNodes++;
+					if(neighborState->hCost < bestHeuristic){
+						bestHeuristic = neighborState->hCost;
+						bestNode = neighborNode;
+					}
 				}
-				if(neighborState->visited){
-					continue;
-				}
-				if(currentState->realCost + neighbor.cost < neighborState->realCost){
+				if(currentCost + neighbor.cost < neighborState->realCost){
 					neighborState->action = neighbor.action;
-					neighborState->previous = currentState;
-					neighborState->realCost = currentState->realCost + neighbor.cost;
-					frontier.push({neighbor.state,-(neighborState->realCost + neighborState->hCost)});
+					neighborState->previous = currentNode;
+					neighborState->realCost = currentCost + neighbor.cost;
+					if(neighborState->visited){
+						neighborState->visited = false;
+						reopenedNodes++;
+					}else if(frontier.contains(neighborNode)){
+						decreasedKeys++;
+					}
+					frontier.push(neighborNode,neighborState->realCost + weight*neighborState->hCost,neighborState->realCost,neighborState->hCost);
 				}
 			}
 		}
 		if(goal){
-			while(currentState){
-				currentState->path = true;
-				solution.push_back({currentState->action,currentState->state});
-				currentState = currentState->previous;
+			solution = buildPath(knownStates,currentNode);
+			termination = Termination::SOLVED;
+		}else if(!termination){
+			termination = Termination::EXHAUSTED;
+		}
+		if(metrics){
+			metrics->timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+			metrics->frontierNodes = knownStates.size();
+			metrics->expandedNodes = expandedNodes;
+			metrics->visitedNodes = visitedNodes;
+			metrics->reopenedNodes = reopenedNodes;
+			metrics->decreasedKeys = decreasedKeys;
+			metrics->evaluatedNodes = evaluatedNodes;
+			metrics->savedEvaluations = 0;
+			metrics->termination = termination;
+			metrics->bestHeuristic = bestHeuristic;
+			metrics->partialActions = goal?std::vector<idaction_t>():buildActions(knownStates,bestNode);
+			metrics->strategy = SearchStrategy::ASTAR;
+			metrics->bucketQueue = frontier.isBucketed();
+			metrics->tieBreaking = parameters->tieBreaking;
+			metrics->solutions = goal;
+			metrics->bound = goal?std::max(1.0,weight):INF;
+			metrics->threadExpansions.clear();
+			metrics->sentNodes = metrics->sentMessages = 0;
+		}
+		return solution;
+	}
+	
+	// Anytime repairing A* (ARA*): a weighted search returns a first solution fast, then the weight is lowered and the
+	// search resumes over the same known states, reporting every improved solution with its suboptimality bound
+	// Within one weight an expanded state is not reopened, it waits in the inconsistent list until the next weight
+	template <typename T,typename G,typename H> Path<T> AnytimeAStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,void (*solutionFunction)(const Path<T>& path,double bound),AStarMetrics* metrics,const AStarParameters* parameters){
+		Path<T> solution;
+		AStarParameters defaultParameters;
+		if(!parameters){ parameters = &defaultParameters; }
+		double weight = std::max(1.0,parameters->weight);
+		double bound = INF;
+		OpenList frontier(parameters->bucketQueue,parameters->tieBreaking);
+		StateTable<T> knownStates;
+		std::vector<idnode_t> inconsistent;
+		unsigned int expandedNodes = 0;
+		unsigned int visitedNodes = 1;
+		unsigned int reopenedNodes = 0;
+		unsigned int decreasedKeys = 0;
+		unsigned int evaluatedNodes = 1;
+		unsigned int solutions = 0;
+		unsigned int termination = Termination::NONE;
+		Budget budget(parameters);
+		bool bucketed = parameters->bucketQueue;
+		Node<T> initialNode(initialState);
+		auto tStart = std::chrono::steady_clock::now();
+		idnode_t initial = knownStates.insert(initialNode.getIdentifier(),NodeState<T>(initialState));
+		double bestHeuristic = knownStates[initial].hCost = heuristicFunction(initialState);
+		idnode_t bestNode = initial;
+		knownStates[initial].isNew = false;
+		frontier.push(initial,weight*knownStates[initial].hCost,0.0,knownStates[initial].hCost);
+		idnode_t goalNode = NONODE;
+		double goalCost = INF;
+		// Keeps the goal as the incumbent when it improves the previous one, with the bound reached for it
+		auto record = [&](double goalBound){
+			if(knownStates[goalNode].realCost >= goalCost){ return; }
+			goalCost = knownStates[goalNode].realCost;
+			solution = buildPath(knownStates,goalNode);
+			solutions++;
+			bound = goalBound;
+			if(solutionFunction){ solutionFunction(solution,bound); }
+			if(parameters->solutionFunction){ parameters->solutionFunction(buildActions(knownStates,goalNode),goalCost,bound,parameters->solutionData); }
+		};
+		while(!termination){
+			while(!frontier.empty()){
+				if((termination = budget.check(expandedNodes))){ break; }
+				NodeState<T> &top = knownStates[frontier.top()];
+				if(goalNode != NONODE && top.realCost + weight*top.hCost >= knownStates[goalNode].realCost + weight*knownStates[goalNode].hCost){ break; }
+				idnode_t currentNode = frontier.pop();
+				knownStates[currentNode].visited = true;
+				if(goalFunction(knownStates[currentNode].state)){
+					if(goalNode == NONODE || knownStates[currentNode].realCost < knownStates[goalNode].realCost){ goalNode = currentNode; }
+					continue;
+				}
+				NodeNeighbors<T> neighbors = knownStates[currentNode].state.getNeighbors();
+				visitedNodes += neighbors.size();
+				expandedNodes++;
+				double currentCost = knownStates[currentNode].realCost;
+				for(Edge<T> &neighbor : neighbors){
+					idnode_t neighborNode = knownStates.lookup(neighbor.state.getIdentifier());
+					NodeState<T> *neighborState = &knownStates[neighborNode];
+					if(neighborState->isNew){
+						neighborState->hCost = heuristicFunction(neighborState->state = neighbor.state.getState());
+						neighborState->isNew = false;
+						evaluatedNodes++;
+						if(neighborState->hCost < bestHeuristic){
+							bestHeuristic = neighborState->hCost;
+							bestNode = neighborNode;
+						}
+					}
+					if(currentCost + neighbor.cost < neighborState->realCost){
+						neighborState->action = neighbor.action;
+						neighborState->previous = currentNode;
+						neighborState->realCost = currentCost + neighbor.cost;
+						if(neighborState->visited){
+							inconsistent.push_back(neighborNode);
+							continue;
+						}
+						if(frontier.contains(neighborNode)){ decreasedKeys++; }
+						frontier.push(neighborNode,neighborState->realCost + weight*neighborState->hCost,neighborState->realCost,neighborState->hCost);
+					}
+				}
+			}
+			if(goalNode == NONODE){ break; }
+			// An interrupted round can't bound the incumbent better than its weight, a goal it popped is still reported
+			if(termination){
+				record(weight);
+				break;
 			}
-			std::reverse(solution.begin(),solution.end());
+			// Every state that can still improve the solution is open or inconsistent
+			double lowerBound = knownStates[goalNode].realCost;
+			for(idnode_t node = 0; node < knownStates.size(); node++){
+				if(frontier.contains(node)){ lowerBound = std::min(lowerBound,knownStates[node].realCost + knownStates[node].hCost); }
+			}
+			for(idnode_t node : inconsistent){ lowerBound = std::min(lowerBound,knownStates[node].realCost + knownStates[node].hCost); }
+			double roundBound = std::min(weight,lowerBound > 0.0?knownStates[goalNode].realCost/lowerBound:1.0);
+			record(roundBound);
+			bound = std::min(bound,roundBound);
+			if(weight <= 1.0 || bound <= 1.0){ break; }
+			// Lower the weight: open and inconsistent states are queued again with the new priorities, closed states are released
+			weight = std::max(1.0,weight - parameters->weightDecrement);
+			bucketed = bucketed && frontier.isBucketed();
+			OpenList nextFrontier(bucketed,parameters->tieBreaking);
+			for(idnode_t node = 0; node < knownStates.size(); node++){
+				NodeState<T> &nodeState = knownStates[node];
+				if(frontier.contains(node)){ nextFrontier.push(node,nodeState.realCost + weight*nodeState.hCost,nodeState.realCost,nodeState.hCost); }
+				nodeState.visited = false;
+			}
+			for(idnode_t node : inconsistent){
+				NodeState<T> &nodeState = knownStates[node];
+				if(nextFrontier.contains(node)){ continue; }
+				nextFrontier.push(node,nodeState.realCost + weight*nodeState.hCost,nodeState.realCost,nodeState.hCost);
+				reopenedNodes++;
+			}
+			inconsistent.clear();
+			std::swap(frontier,nextFrontier);
 		}
+		if(!termination){ termination = solutions?Termination::SOLVED:Termination::EXHAUSTED; }
 		if(metrics){
 			metrics->timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
 			metrics->frontierNodes = knownStates.size();
 			metrics->expandedNodes = expandedNodes;
 			metrics->visitedNodes = visitedNodes;
+			metrics->reopenedNodes = reopenedNodes;
+			metrics->decreasedKeys = decreasedKeys;
+			metrics->evaluatedNodes = evaluatedNodes;
+			metrics->savedEvaluations = 0;
+			metrics->termination = termination;
+			metrics->bestHeuristic = bestHeuristic;
+			metrics->partialActions = solutions?std::vector<idaction_t>():buildActions(knownStates,bestNode);
+			metrics->strategy = SearchStrategy::ANYTIME;
+			metrics->bucketQueue = frontier.isBucketed();
+			metrics->tieBreaking = parameters->tieBreaking;
+			metrics->solutions = solutions;
+			metrics->bound = bound;
+			metrics->threadExpansions.clear();
+			metrics->sentNodes = metrics->sentMessages = 0;
 		}
 		return solution;
 	}
 	
+	// Greedy best first search with deferred evaluation: generated states are queued with the heuristic value of their
+	// parent and evaluated only when popped, so states that are never expanded never pay for the heuristic
+	// States are not reopened, the first path found to a state is kept
+	template <typename T,typename G,typename H> Path<T> GreedyBestFirst(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics,const AStarParameters* parameters){
+		Path<T> solution;
+		AStarParameters defaultParameters;
+		if(!parameters){ parameters = &defaultParameters; }
+		OpenList frontier(parameters->bucketQueue,parameters->tieBreaking);
+		StateTable<T> knownStates;
+		unsigned int expandedNodes = 0;
+		unsigned int visitedNodes = 1;
+		unsigned int evaluatedNodes = 0;
+		unsigned int termination = Termination::NONE;
+		Budget budget(parameters);
+		Node<T> initialNode(initialState);
+		auto tStart = std::chrono::steady_clock::now();
+		idnode_t initial = knownStates.insert(initialNode.getIdentifier(),NodeState<T>(initialState));
+		knownStates[initial].isNew = false;
+		frontier.push(initial,0.0,0.0,0.0);
+		idnode_t currentNode = NONODE;
+		idnode_t bestNode = initial;
+		double bestHeuristic = INF;
+		bool goal = false;
+		while(!frontier.empty()){
+			if((termination = budget.check(expandedNodes))){ break; }
+			currentNode = frontier.pop();
+			if(goalFunction(knownStates[currentNode].state)){
+				goal = true;
+				break;
+			}
+			double hCost = knownStates[currentNode].hCost = heuristicFunction(knownStates[currentNode].state);
+			evaluatedNodes++;
+			if(hCost < bestHeuristic){
+				bestHeuristic = hCost;
+				bestNode = currentNode;
+			}
+			if(hCost == INF){ continue; }
+			NodeNeighbors<T> neighbors = knownStates[currentNode].state.getNeighbors();
+			visitedNodes += neighbors.size();
+			expandedNodes++;
+			knownStates[currentNode].visited = true;
+			double currentCost = knownStates[currentNode].realCost;
+			for(Edge<T> &neighbor : neighbors){
+				idnode_t neighborNode = knownStates.lookup(neighbor.state.getIdentifier());
+				NodeState<T> *neighborState = &knownStates[neighborNode];
+				if(!neighborState->isNew){ continue; }
+				neighborState->state = neighbor.state.getState();
+				neighborState->isNew = false;
+				neighborState->action = neighbor.action;
+				neighborState->previous = currentNode;
+				neighborState->realCost = currentCost + neighbor.cost;
+				frontier.push(neighborNode,hCost,neighborState->realCost,hCost);
+			}
+		}
+		if(goal){
+			solution = buildPath(knownStates,currentNode);
+			termination = Termination::SOLVED;
+			bestHeuristic = 0.0;
+		}else if(!termination){
+			termination = Termination::EXHAUSTED;
+		}
+		if(metrics){
+			metrics->timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+			metrics->frontierNodes = knownStates.size();
+			metrics->expandedNodes = expandedNodes;
+			metrics->visitedNodes = visitedNodes;
+			metrics->reopenedNodes = 0;
+			metrics->decreasedKeys = 0;
+			metrics->evaluatedNodes = evaluatedNodes;
+			metrics->savedEvaluations = knownStates.size() - evaluatedNodes;
+			metrics->termination = termination;
+			metrics->bestHeuristic = bestHeuristic;
+			metrics->partialActions = goal?std::vector<idaction_t>():buildActions(knownStates,bestNode);
+			metrics->strategy = SearchStrategy::GREEDY;
+			metrics->bucketQueue = frontier.isBucketed();
+			metrics->tieBreaking = parameters->tieBreaking;
+			metrics->solutions = goal;
+			metrics->bound = INF;
+			metrics->threadExpansions.clear();
+			metrics->sentNodes = metrics->sentMessages = 0;
+		}
+		return solution;
+	}
+	
+	// Iterative deepening A*: depth first searches bounded by f = g + weight*h, raising the bound to the lowest f that
+	// exceeded it until a goal is found. Only the current path and its pending neighbors are kept, so memory grows with
+	// the solution depth instead of the number of states; states already on the path are skipped to avoid cycles
+	template <typename T,typename G,typename H> Path<T> IDAStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics,const AStarParameters* parameters){
+		class Frame{
+			public:
+				Node<T> node;
+				NodeNeighbors<T> neighbors;
+				size_t next;
+				double realCost;
+				idaction_t action;
+				Frame(const Node<T> &n,double g,idaction_t a) : node(n), next(0), realCost(g), action(a) {};
+		};
+		Path<T> solution;
+		AStarParameters defaultParameters;
+		if(!parameters){ parameters = &defaultParameters; }
+		double weight = parameters->weight;
+		std::vector<Frame> stack;
+		size_t maximumDepth = 1;
+		unsigned int expandedNodes = 0;
+		unsigned int visitedNodes = 1;
+		unsigned int evaluatedNodes = 1;
+		unsigned int termination = Termination::NONE;
+		Budget budget(parameters);
+		std::vector<idaction_t> partialActions;
+		Node<T> initialNode(initialState);
+		auto tStart = std::chrono::steady_clock::now();
+		double bestHeuristic = heuristicFunction(initialState);
+		double bound = weight*bestHeuristic;
+		bool goal = false;
+		while(!goal && !termination && bound != INF){
+			double nextBound = INF;
+			stack.clear();
+			stack.emplace_back(initialNode,0.0,0);
+			if(goalFunction(initialNode.getState())){
+				goal = true;
+				break;
+			}
+			while(!stack.empty()){
+				Frame &frame = stack.back();
+				if(!frame.next && frame.neighbors.empty()){
+					if((termination = budget.check(expandedNodes))){ break; }
+					frame.neighbors = frame.node.getNeighbors();
+					visitedNodes += frame.neighbors.size();
+					expandedNodes++;
+				}
+				if(frame.next >= frame.neighbors.size()){
+					frame.node.releaseNeighbors();
+					stack.pop_back();
+					continue;
+				}
+				Edge<T> &neighbor = frame.neighbors[frame.next++];
+				idstate_t key = neighbor.state.getIdentifier();
+				bool cycle = false;
+				for(Frame &ancestor : stack){
+					if(ancestor.node.getIdentifier() == key){
+						cycle = true;
+						break;
+					}
+				}
+				if(cycle){ continue; }
+				double realCost = frame.realCost + neighbor.cost;
+				double hCost = heuristicFunction(neighbor.state.getState());
+				double f = realCost + weight*hCost;
+				evaluatedNodes++;
+				if(hCost < bestHeuristic){
+					bestHeuristic = hCost;
+					partialActions.clear();
+					for(size_t i = 1; i < stack.size(); i++){ partialActions.push_back(stack[i].action); }
+					partialActions.push_back(neighbor.action);
+				}
+				if(f > bound){
+					nextBound = std::min(nextBound,f);
+					continue;
+				}
+				stack.emplace_back(neighbor.state,realCost,neighbor.action);
+				maximumDepth = std::max(maximumDepth,stack.size());
+				if(goalFunction(stack.back().node.getState())){
+					goal = true;
+					break;
+				}
+			}
+			bound = nextBound;
+		}
+		if(goal){
+			for(Frame &frame : stack){ solution.push_back({frame.action,frame.node.getState()}); }
+			termination = Termination::SOLVED;
+		}else if(!termination){
+			termination = Termination::EXHAUSTED;
+		}
+		if(metrics){
+			metrics->timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+			metrics->frontierNodes = maximumDepth;
+			metrics->expandedNodes = expandedNodes;
+			metrics->visitedNodes = visitedNodes;
+			metrics->reopenedNodes = 0;
+			metrics->decreasedKeys = 0;
+			metrics->evaluatedNodes = evaluatedNodes;
+			metrics->savedEvaluations = 0;
+			metrics->termination = termination;
+			metrics->bestHeuristic = goal?0.0:bestHeuristic;
+			metrics->partialActions = goal?std::vector<idaction_t>():partialActions;
+			metrics->strategy = SearchStrategy::IDASTAR;
+			metrics->bucketQueue = false;
+			metrics->tieBreaking = parameters->tieBreaking;
+			metrics->solutions = goal;
+			metrics->bound = goal?std::max(1.0,weight):INF;
+			metrics->threadExpansions.clear();
+			metrics->sentNodes = metrics->sentMessages = 0;
+		}
+		return solution;
+	}
+	
+	// Hash distributed A* (HDA*): every state is owned by the worker selected by the hash of its key, each worker keeps
+	// its own open list and state table and sends generated states to their owners in batches through lock free queues
+	// Workers stop expanding once their best f reaches the incumbent solution cost; the search ends when every worker is
+	// idle and no message is in flight, so the incumbent is optimal as in sequential A* with reopening
+	template <typename T,typename G,typename H> Path<T> HDAStar(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics,const AStarParameters* parameters){
+		class Message{
+			public:
+				T state;
+				idstate_t key;
+				double realCost;
+				idaction_t action;
+				unsigned int previousWorker;
+				idnode_t previous;
+		};
+		using Batch = std::vector<Message>;
+		class Worker{
+			public:
+				StateTable<T> knownStates;
+				std::vector<unsigned int> previousWorker;
+				OpenList frontier;
+				MessageQueue<Batch> inbox;
+				std::vector<Batch> outbox;
+				unsigned int expandedNodes;
+				unsigned int visitedNodes;
+				unsigned int reopenedNodes;
+				unsigned int decreasedKeys;
+				unsigned int evaluatedNodes;
+				unsigned int sentNodes;
+				unsigned int sentMessages;
+				Budget budget;
+				double bestHeuristic;
+				idnode_t bestNode;
+				Worker(bool useBuckets,unsigned int tieBreaking,unsigned int threads,const AStarParameters* parameters) : frontier(useBuckets,tieBreaking), outbox(threads), expandedNodes(0), visitedNodes(0), reopenedNodes(0), decreasedKeys(0), evaluatedNodes(0), sentNodes(0), sentMessages(0), budget(parameters), bestHeuristic(INF), bestNode(NONODE) {};
+		};
+		const size_t BATCH = 64;
+		Path<T> solution;
+		AStarParameters defaultParameters;
+		if(!parameters){ parameters = &defaultParameters; }
+		double weight = parameters->weight;
+		unsigned int threads = parameters->threads?parameters->threads:std::max(1u,std::thread::hardware_concurrency());
+		std::vector<Worker*> workers;
+		for(unsigned int i = 0; i < threads; i++){ workers.push_back(new Worker(parameters->bucketQueue,parameters->tieBreaking,threads,parameters)); }
+		std::mutex expansionMutex;
+		std::mutex goalMutex;
+		std::atomic<double> goalCost(INF);
+		unsigned int goalWorker = 0;
+		idnode_t goalNode = NONODE;
+		std::atomic<long long int> pendingMessages(0);
+		std::atomic<unsigned int> idleWorkers(0);
+		std::atomic<unsigned long long int> activations(0);
+		std::atomic<bool> finished(false);
+		std::atomic<unsigned long long int> expansions(0);
+		std::atomic<unsigned int> termination(Termination::NONE);
+		auto owner = [threads](idstate_t key){ return (unsigned int)((hashState(key) >> 32) % threads); };
+		// Relaxes the state in the table of the worker that owns it
+		auto receive = [&](Worker* worker,Message &message){
+			idnode_t node = worker->knownStates.lookup(message.key);
+			if(node >= worker->previousWorker.size()){ worker->previousWorker.resize(std::max<size_t>(node+1,worker->previousWorker.size()<<1)); }
+			NodeState<T> *nodeState = &worker->knownStates[node];
+			if(nodeState->isNew){
+				nodeState->hCost = heuristicFunction(nodeState->state = message.state);
+				nodeState->isNew = false;
+				worker->evaluatedNodes++;
+				if(nodeState->hCost < worker->bestHeuristic){
+					worker->bestHeuristic = nodeState->hCost;
+					worker->bestNode = node;
+				}
+			}
+			if(message.realCost < nodeState->realCost){
+				nodeState->action = message.action;
+				nodeState->previous = message.previous;
+				nodeState->realCost = message.realCost;
+				worker->previousWorker[node] = message.previousWorker;
+				if(nodeState->visited){
+					nodeState->visited = false;
+					worker->reopenedNodes++;
+				}else if(worker->frontier.contains(node)){
+					worker->decreasedKeys++;
+				}
+				worker->frontier.push(node,nodeState->realCost + weight*nodeState->hCost,nodeState->realCost,nodeState->hCost);
+			}
+		};
+		auto send = [&](Worker* worker,unsigned int destination){
+			Batch &batch = worker->outbox[destination];
+			worker->sentNodes += batch.size();
+			worker->sentMessages++;
+			pendingMessages.fetch_add(1);
+			workers[destination]->inbox.push(batch);
+			batch.clear();
+		};
+		auto work = [&](unsigned int id){
+			Worker* worker = workers[id];
+			bool idle = false;
+			Batch batch;
+			while(!finished.load()){
+				// A worker leaves the idle count before it receives, and every batch bumps the activations before it stops
+				// being pending: a checker that reads no pending messages after taking its epoch either sees this worker busy
+				// or sees the epoch change, so no batch can be received unnoticed between its two loads
+				while(worker->inbox.pop(batch)){
+					if(idle){
+						idle = false;
+						idleWorkers.fetch_sub(1);
+					}
+					for(Message &message : batch){ receive(worker,message); }
+					activations.fetch_add(1);
+					pendingMessages.fetch_sub(1);
+				}
+				if(!worker->frontier.empty()){
+					NodeState<T> &top = worker->knownStates[worker->frontier.top()];
+					if(top.realCost + weight*top.hCost < goalCost.load()){
+						unsigned int limit = worker->budget.check(expansions.load());
+						if(limit){
+							unsigned int none = Termination::NONE;
+							termination.compare_exchange_strong(none,limit);
+							finished.store(true);
+							break;
+						}
+						idnode_t currentNode = worker->frontier.pop();
+						NodeState<T> *currentState = &worker->knownStates[currentNode];
+						currentState->visited = true;
+						double currentCost = currentState->realCost;
+						NodeNeighbors<T> neighbors;
+						{
+							std::unique_lock<std::mutex> lock(expansionMutex,std::defer_lock);
+							if(parameters->exclusiveExpansion){ lock.lock(); }
+							if(goalFunction(currentState->state)){
+								std::lock_guard<std::mutex> goalLock(goalMutex);
+								if(currentCost < goalCost.load()){
+									goalCost.store(currentCost);
+									goalWorker = id;
+									goalNode = currentNode;
+								}
+								continue;
+							}
+							neighbors = currentState->state.getNeighbors();
+						}
+						worker->visitedNodes += neighbors.size();
+						worker->expandedNodes++;
+						expansions.fetch_add(1);
+						for(Edge<T> &neighbor : neighbors){
+							idstate_t key = neighbor.state.getIdentifier();
+							unsigned int destination = owner(key);
+							Message message{neighbor.state.getState(),key,currentCost + neighbor.cost,neighbor.action,id,currentNode};
+							if(destination == id){
+								receive(worker,message);
+								continue;
+							}
+							worker->outbox[destination].push_back(message);
+							if(worker->outbox[destination].size() >= BATCH){ send(worker,destination); }
+						}
+						continue;
+					}
+				}
+				// Nothing left below the incumbent: flush pending states and check for termination
+				for(unsigned int destination = 0; destination < threads; destination++){
+					if(!worker->outbox[destination].empty()){ send(worker,destination); }
+				}
+				if(!idle){
+					idle = true;
+					idleWorkers.fetch_add(1);
+				}
+				unsigned long long int epoch = activations.load();
+				if(idleWorkers.load() == threads && !pendingMessages.load() && activations.load() == epoch){
+					finished.store(true);
+					break;
+				}
+				std::this_thread::yield();
+			}
+		};
+		auto tStart = std::chrono::steady_clock::now();
+		Node<T> initialNode(initialState);
+		Worker* initialWorker = workers[owner(initialNode.getIdentifier())];
+		idnode_t initial = initialWorker->knownStates.insert(initialNode.getIdentifier(),NodeState<T>(initialState));
+		initialWorker->previousWorker.resize(initial+1);
+		initialWorker->bestHeuristic = initialWorker->knownStates[initial].hCost = heuristicFunction(initialState);
+		initialWorker->bestNode = initial;
+		initialWorker->knownStates[initial].isNew = false;
+		initialWorker->evaluatedNodes++;
+		initialWorker->frontier.push(initial,weight*initialWorker->knownStates[initial].hCost,0.0,initialWorker->knownStates[initial].hCost);
+		std::vector<std::thread> pool;
+		for(unsigned int i = 0; i < threads; i++){ pool.emplace_back(work,i); }
+		for(std::thread &thread : pool){ thread.join(); }
+		// Follows the previous states through the tables of the workers that own them
+		auto walk = [&](unsigned int workerId,idnode_t node){
+			Path<T> path;
+			while(node != NONODE){
+				Worker* worker = workers[workerId];
+				NodeState<T> &nodeState = worker->knownStates[node];
+				nodeState.path = true;
+				path.push_back({nodeState.action,nodeState.state});
+				workerId = worker->previousWorker[node];
+				node = nodeState.previous;
+			}
+			std::reverse(path.begin(),path.end());
+			return path;
+		};
+		unsigned int bestWorker = 0;
+		for(unsigned int i = 1; i < threads; i++){
+			if(workers[i]->bestHeuristic < workers[bestWorker]->bestHeuristic){ bestWorker = i; }
+		}
+		// An incumbent found before a limit stopped the search is still returned, but it isn't proven within the weight
+		bool goal = goalNode != NONODE;
+		bool interrupted = termination.load() != Termination::NONE;
+		if(goal){ solution = walk(goalWorker,goalNode); }
+		if(!interrupted){ termination.store(goal?Termination::SOLVED:Termination::EXHAUSTED); }
+		if(metrics){
+			metrics->timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+			metrics->frontierNodes = metrics->expandedNodes = 0;
+			metrics->visitedNodes = 1;
+			metrics->reopenedNodes = metrics->decreasedKeys = metrics->evaluatedNodes = 0;
+			metrics->sentNodes = metrics->sentMessages = 0;
+			metrics->threadExpansions.clear();
+			metrics->bucketQueue = true;
+			for(Worker* worker : workers){
+				metrics->frontierNodes += worker->knownStates.size();
+				metrics->expandedNodes += worker->expandedNodes;
+				metrics->visitedNodes += worker->visitedNodes;
+				metrics->reopenedNodes += worker->reopenedNodes;
+				metrics->decreasedKeys += worker->decreasedKeys;
+				metrics->evaluatedNodes += worker->evaluatedNodes;
+				metrics->sentNodes += worker->sentNodes;
+				metrics->sentMessages += worker->sentMessages;
+				metrics->threadExpansions.push_back(worker->expandedNodes);
+				metrics->bucketQueue = metrics->bucketQueue && worker->frontier.isBucketed();
+			}
+			metrics->savedEvaluations = 0;
+			metrics->termination = termination.load();
+			metrics->bestHeuristic = goal?0.0:workers[bestWorker]->bestHeuristic;
+			metrics->partialActions.clear();
+			if(!goal){
+				for(std::pair<idaction_t,T> &step : walk(bestWorker,workers[bestWorker]->bestNode)){ metrics->partialActions.push_back(step.first); }
+				if(!metrics->partialActions.empty()){ metrics->partialActions.erase(metrics->partialActions.begin()); }
+			}
+			metrics->strategy = SearchStrategy::HDASTAR;
+			metrics->tieBreaking = parameters->tieBreaking;
+			metrics->solutions = goal;
+			metrics->bound = goal && !interrupted?std::max(1.0,weight):INF;
+		}
+		for(Worker* worker : workers){ delete worker; }
+		return solution;
+	}
+	
+	// Runs the search engine selected by the parameters
+	template <typename T,typename G,typename H> Path<T> Search(const T& initialState,const G& goalFunction,const H& heuristicFunction,AStarMetrics* metrics,const AStarParameters* parameters){
+		switch(parameters?parameters->strategy:SearchStrategy::ASTAR){
+			case SearchStrategy::ANYTIME: return AnytimeAStar(initialState,goalFunction,heuristicFunction,(void (*)(const Path<T>&,double))0,metrics,parameters);
+			case SearchStrategy::GREEDY: return GreedyBestFirst(initialState,goalFunction,heuristicFunction,metrics,parameters);
+			case SearchStrategy::IDASTAR: return IDAStar(initialState,goalFunction,heuristicFunction,metrics,parameters);
+			case SearchStrategy::HDASTAR: return HDAStar(initialState,goalFunction,heuristicFunction,metrics,parameters);
+			default: return AStar(initialState,goalFunction,heuristicFunction,metrics,parameters);
+		}
+	}
+	
 };
 #endif
@@ -30,33 +30,37 @@ namespace Expressions{
 	};
 	
 	// Expression class
-	WordMap Expression::words;
-	ExpressionMap Expression::exprs;
-	ReverseWordMap Expression::iwords;
-	ReverseExpressionMap Expression::iexprs;
+	Context Expression::global;
+	thread_local Context* Expression::context = &Expression::global;
 	Expression::Expression() : type(ExpressionType::NONE) {};
 	Expression::Expression(idexpr_t k, idtype_t t) : key(k),type(t) {};
 	Expression::~Expression(){};
 	bool Expression::isModeledBy(World* world){ return false; }
 	bool Expression::isLaxModeledBy(World* maxWorld,World* minWorld){ return false; }
-	void Expression::apply(World* world,Atoms &addList,Atoms &removeList){}
+	void Expression::apply(World* world,Facts &addList,Facts &removeList){}
 	void Expression::applyPositive(Atoms &addList,Atoms &removeList){}
+	void Expression::requiredAtoms(Atoms &positive,Atoms &negative){}
+	Expression* Expression::simplify(const std::set<idexpr_t> &fluents,const Atoms &initial){ return this; }
+	bool Expression::compileCondition(Facts &positive,Facts &negative){ return false; }
+	bool Expression::compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional){ return false; }
 	Expression* Expression::substitute(idexpr_t o,idexpr_t n){ return this; }
+	Expression* Expression::ground(){ return this; }
 	std::ostream& Expression::print(std::ostream& out) const { return out<<"Undefined"; }
 	std::ostream& operator<<(std::ostream &out, Expression &e){ return e.print(out); }
 	inline idexpr_t Expression::registerWord(const std::string &str){
-		idexpr_t key = iwords[str];
-		words[key] = str;
+		idexpr_t key = context->iwords[str];
+		context->words[key] = str;
 		return key;
 	}
 	inline Expression* Expression::registerConstant(const std::string &cnt){
 		idexpr_t idcnt = registerWord(cnt);
 		idexpr_t key = idcnt;
-		Expression** exprPtr = &exprs[key];
-		if(!*exprPtr){
-			*exprPtr = new Constant(key,idcnt);
+		Expression* expr = context->exprs.find(key);
+		if(!expr){
+			expr = context->constants.make(key,idcnt);
+			context->exprs.insert(expr);
 		}
-		return *exprPtr;
+		return expr;
 	}
 	inline Expression* Expression::registerVariable(const std::string &var,const std::string &grp){
 		idexpr_t idvar = registerWord(var), idgrp, key;
@@ -66,105 +70,416 @@ namespace Expressions{
 		}else{
 			idgrp = registerWord(grp);
 			Arguments args{idvar,idgrp};
-			key = iexprs[args] | (ExpressionType::VARIABLE<<EXPRESSION_TYPE_OFFSET);
+			key = context->iexprs[lowestBit(ExpressionType::VARIABLE)][args] | (ExpressionType::VARIABLE<<EXPRESSION_TYPE_OFFSET);
 		}
-		Expression** exprPtr = &exprs[key];
-		if(!*exprPtr){
-			*exprPtr = new Variable(key,idvar,idgrp);
+		Expression* expr = context->exprs.find(key);
+		if(!expr){
+			expr = context->variables.make(key,idvar,idgrp);
+			context->exprs.insert(expr);
 		}
-		return *exprPtr;
+		return expr;
 	}
 	inline Expression* Expression::registerExpression(idtype_t type, Arguments &args){
-		idexpr_t key = iexprs[args] | (type<<EXPRESSION_TYPE_OFFSET);
-		Expression** exprPtr = &exprs[key];
-		if(!*exprPtr){
+		idexpr_t key = context->iexprs[lowestBit(type)][args] | (type<<EXPRESSION_TYPE_OFFSET);
+		Expression* expr = context->exprs.find(key);
+		if(!expr){
+			ArgumentSpan span = context->arguments.store(args);
 			switch(type){
 				case ExpressionType::ATOM:
-					*exprPtr = new Atom(key,args);
+					expr = context->atoms.make(key,span);
 					break;
 				case ExpressionType::AND:
-					*exprPtr = new And(key,args);
+					expr = context->ands.make(key,span);
 					break;
 				case ExpressionType::OR:
-					*exprPtr = new Or(key,args);
+					expr = context->ors.make(key,span);
 					break;
 				case ExpressionType::NOT:
-					*exprPtr = new Not(key,args);
+					expr = context->nots.make(key,span);
 					break;
 				case ExpressionType::EQUALS:
-					*exprPtr = new Equals(key,args);
+					expr = context->equals.make(key,span);
 					break;
 				case ExpressionType::IMPLY:
-					*exprPtr = new Imply(key,args);
+					expr = context->implies.make(key,span);
 					break;
 				case ExpressionType::WHEN:
-					*exprPtr = new When(key,args);
+					expr = context->whens.make(key,span);
 					break;
 				case ExpressionType::EXISTS:
-					*exprPtr = new Exists(key,args);
+					expr = context->exists.make(key,span);
 					break;
 				case ExpressionType::FORALL:
-					*exprPtr = new Forall(key,args);
+					expr = context->foralls.make(key,span);
 					break;
 			}
+			context->exprs.insert(expr);
+		}
+		return expr;
+	}
+	inline World* Expression::registerWorld(Bits &bits,uint64_t hash,const World* parent){
+		while(!bits.empty() && !bits.back()){ bits.pop_back(); }
+		return context->registry->find(bits,hash,parent);
+	}
+	
+	// Expression table class
+	const idexpr_t ExpressionTable::MASK;
+	void ExpressionTable::insert(Expression* expr){
+		size_t id = expr->key & MASK;
+		if(id >= entries.size()){
+			entries.resize(std::max<size_t>(id+1,entries.size()*2),0);
+			types.resize(entries.size(),ExpressionType::NONE);
+		}
+		entries[id] = expr;
+		types[id] = expr->type;
+	}
+	void ExpressionTable::clear(){
+		entries.clear();
+		types.clear();
+	}
+	
+	// Context class
+	Context::Context() : iwords(&identifiers), iexprs(16,ReverseExpressionMap(&identifiers)), registry(&worlds) {};
+	void Context::clear(){
+		words.clear();
+		exprs.clear();
+		constants.clear();
+		variables.clear();
+		atoms.clear();
+		ands.clear();
+		ors.clear();
+		nots.clear();
+		equals.clear();
+		implies.clear();
+		whens.clear();
+		exists.clear();
+		foralls.clear();
+		arguments.clear();
+		iwords.clear();
+		for(ReverseExpressionMap &trie : iexprs){ trie.clear(); }
+		identifiers.restart();
+		facts.clear();
+		groups.clear();
+		worlds.clear();
+	}
+	
+	// Argument pool class
+	const size_t ArgumentPool::CHUNK;
+	ArgumentSpan ArgumentPool::store(const Arguments &args){
+		if(args.empty()){ return ArgumentSpan(); }
+		idexpr_t* run;
+		if(args.size() > CHUNK){
+			run = new idexpr_t[args.size()];
+			chunks.insert(chunks.empty()?chunks.end():chunks.end()-1,run);
+		}else{
+			if(used + args.size() > CHUNK){
+				chunks.push_back(new idexpr_t[CHUNK]);
+				used = 0;
+			}
+			run = chunks.back()+used;
+			used += args.size();
+		}
+		std::copy(args.begin(),args.end(),run);
+		return ArgumentSpan(run,(uint32_t)args.size());
+	}
+	void ArgumentPool::clear(){
+		for(idexpr_t* chunk : chunks){ delete[] chunk; }
+		chunks.clear();
+		used = CHUNK;
+	}
+	
+	// World registry class
+	const size_t WorldRegistry::SHARDS;
+	const size_t WorldRegistry::CHUNK;
+	const size_t WorldRegistry::CACHE;
+	WorldRegistry::WorldRegistry(unsigned int s) : count(0), cache(s?CACHE:0), cursor(0), pinned(0), encoding(0), snapshotInterval(s) {};
+	WorldRegistry::~WorldRegistry(){ clear(); }
+	size_t WorldRegistry::size() const { return count.load(); }
+	void* WorldRegistry::allocate(Shard &shard,size_t bytes){
+		bytes = (bytes+7) & ~(size_t)7;
+		if(bytes > shard.available){
+			if(shard.spare.first && (shard.spare.second<<3) >= bytes){
+				shard.chunks.push_back(shard.spare);
+				shard.spare = {0,0};
+			}else{
+				size_t words = std::max(CHUNK,bytes)>>3;
+				shard.chunks.push_back({new uint64_t[words],words});
+			}
+			shard.available = shard.chunks.back().second<<3;
+			shard.next = (char*)shard.chunks.back().first;
+		}
+		void* memory = shard.next;
+		shard.next += bytes;
+		shard.available -= bytes;
+		return memory;
+	}
+	// Worlds get sequential keys, so the keys stay unique even when hashes collide
+	// The parent, when given, is the world the bits were derived from and must belong to this registry
+	World* WorldRegistry::find(Bits &bits,uint64_t hash,const World* parent){
+		// The low bits of the hash place the world in the table of its shard, the high ones choose the shard
+		Shard &shard = shards[hash >> 60];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if((shard.count+1)*2 > shard.slots.size()){ grow(shard); }
+		size_t mask = shard.slots.size()-1;
+		for(size_t i = hash & mask; ; i = (i+1) & mask){
+			World* world = shard.slots[i];
+			if(!world){
+				Registered registered{0,shard.next,shard.available,shard.chunks.size()};
+				shard.count++;
+				world = shard.slots[i] = insert(shard,bits,hash,parent);
+				if(!scopes.empty()){
+					registered.world = world;
+					scoped.push_back(registered);
+				}
+				return world;
+			}
+			if(world->hash == hash && world->length == bits.size()){
+				world->load();
+				if(std::equal(bits.begin(),bits.end(),world->words)){ return world; }
+			}
+		}
+	}
+	World* WorldRegistry::insert(Shard &shard,Bits &bits,uint64_t hash,const World* parent){
+		idexpr_t key = (count.fetch_add(1)+1) | (ExpressionType::WORLD<<EXPRESSION_TYPE_OFFSET);
+		if(!snapshotInterval && !encoding){
+			void* memory = allocate(shard,sizeof(World) + bits.size()*sizeof(uint64_t));
+			uint64_t* words = (uint64_t*)((char*)memory + sizeof(World));
+			std::copy(bits.begin(),bits.end(),words);
+			return new(memory) World(key,words,bits.size(),hash);
+		}
+		Facts toggles;
+		uint32_t depth = 0;
+		if(parent && snapshotInterval){
+			depth = static_cast<const DeltaWorld*>(parent)->depth + 1;
+			parent->load();
+			size_t length = std::max<size_t>(bits.size(),parent->length);
+			for(size_t word = 0; word < length; word++){
+				for(uint64_t b = (word < bits.size()?bits[word]:0) ^ parent->word(word); b; b &= b-1){ toggles.push_back((word<<6) | lowestBit(b)); }
+			}
+		}
+		Bits packed;
+		if(encoding){ encoding->pack(bits.data(),bits.size(),packed); }
+		size_t snapshot = encoding?packed.size():bits.size();
+		DeltaWorld* world;
+		if(!parent || !snapshotInterval || depth >= snapshotInterval || toggles.size()*sizeof(idfact_t) >= snapshot*sizeof(uint64_t)){
+			void* memory = allocate(shard,sizeof(DeltaWorld) + snapshot*sizeof(uint64_t));
+			uint64_t* words = (uint64_t*)((char*)memory + sizeof(DeltaWorld));
+			if(!encoding){
+				std::copy(bits.begin(),bits.end(),words);
+				return new(memory) DeltaWorld(key,words,bits.size(),hash,0,this,0,0);
+			}
+			std::copy(packed.begin(),packed.end(),words);
+			world = new(memory) DeltaWorld(key,0,bits.size(),hash,0,this,packed.size(),0);
+		}else{
+			void* memory = allocate(shard,sizeof(DeltaWorld) + toggles.size()*sizeof(idfact_t));
+			std::copy(toggles.begin(),toggles.end(),(idfact_t*)((char*)memory + sizeof(DeltaWorld)));
+			world = new(memory) DeltaWorld(key,0,bits.size(),hash,parent,this,toggles.size(),depth);
+		}
+		// New worlds are likely read soon (heuristic, goal), keep the bits at hand
+		Bits &words = buffer(world);
+		words = bits;
+		world->words = words.data();
+		return world;
+	}
+	// Takes the next buffer of the ring for the world, the world that held it loses its words
+	Bits& WorldRegistry::buffer(const World* world){
+		if(cache[cursor].first && cache[cursor].first == pinned){ cursor = (cursor+1) % CACHE; }
+		std::pair<const World*,Bits> &entry = cache[cursor];
+		cursor = (cursor+1) % CACHE;
+		if(entry.first){ entry.first->words = 0; }
+		entry.first = world;
+		return entry.second;
+	}
+	// Rebuilds the words from the closest ancestor that has them (or unpacks its packed snapshot), replaying the toggles down
+	// to the world
+	void WorldRegistry::materialize(const World* world){
+		Bits &bits = buffer(world);
+		std::vector<const DeltaWorld*> chain;
+		const World* base = world;
+		while(!base->words && static_cast<const DeltaWorld*>(base)->parent){
+			chain.push_back(static_cast<const DeltaWorld*>(base));
+			base = chain.back()->parent;
+		}
+		if(base->words){
+			bits.assign(base->words,base->words+base->length);
+		}else{
+			encoding->unpack(static_cast<const DeltaWorld*>(base)->packed(),static_cast<const DeltaWorld*>(base)->toggleCount,bits);
+		}
+		for(size_t i = chain.size(); i--; ){
+			const idfact_t* toggles = chain[i]->toggles();
+			for(uint32_t t = 0; t < chain[i]->toggleCount; t++){
+				idfact_t fact = toggles[t];
+				if((fact>>6) >= bits.size()){ bits.resize((fact>>6)+1,0); }
+				bits[fact>>6] ^= 1ULL<<(fact&63);
+			}
+		}
+		bits.resize(world->length);
+		world->words = bits.data();
+	}
+	void WorldRegistry::mark(){ scopes.push_back(scoped.size()); }
+	// Worlds are released in the reverse order they were registered, so every shard gets its allocation back as it was
+	void WorldRegistry::release(){
+		size_t first = scopes.back();
+		scopes.pop_back();
+		if(first == scoped.size()){ return; }
+		// Keys are sequential, the released worlds have the highest ones and the next worlds take them again
+		if(pinned && pinned->key >= scoped[first].world->key){ pinned = 0; }
+		for(size_t i = scoped.size(); i-- > first; ){
+			Registered &registered = scoped[i];
+			// A world with words from the ring gives its buffer back, most likely one taken just before the cursor
+			const World* world = registered.world;
+			if(!cache.empty() && world->words && (const char*)world->words != (const char*)world + sizeof(DeltaWorld)){
+				for(size_t entry = cursor + CACHE; entry > cursor; entry--){
+					if(cache[(entry-1) % CACHE].first == world){
+						cache[(entry-1) % CACHE].first = 0;
+						break;
+					}
+				}
+			}
+			Shard &shard = shards[registered.world->hash >> 60];
+			erase(shard,registered.world);
+			registered.world->~World();
+			while(shard.chunks.size() > registered.chunks){
+				if(shard.spare.first){ delete[] shard.spare.first; }
+				shard.spare = shard.chunks.back();
+				shard.chunks.pop_back();
+			}
+			shard.next = registered.next;
+			shard.available = registered.available;
+			shard.count--;
+		}
+		count -= scoped.size() - first;
+		scoped.resize(first);
+	}
+	void WorldRegistry::pin(const World* world){
+		if(!cache.empty()){ pinned = world; }
+	}
+	// Worlds registered before keep their words, the encoding must outlive the registry
+	void WorldRegistry::encode(const FiniteDomain* e){
+		encoding = e;
+		if(encoding && cache.empty()){ cache.resize(CACHE); }
+	}
+	void WorldRegistry::grow(Shard &shard){
+		std::vector<World*> old(shard.slots.size()<<1,0);
+		std::swap(old,shard.slots);
+		size_t mask = shard.slots.size()-1;
+		for(World* world : old){
+			if(!world){ continue; }
+			size_t i = world->hash & mask;
+			while(shard.slots[i]){ i = (i+1) & mask; }
+			shard.slots[i] = world;
+		}
+	}
+	// Removes the world from the table of its shard, the later worlds of its probe sequence move back to keep it unbroken
+	void WorldRegistry::erase(Shard &shard,const World* world){
+		size_t mask = shard.slots.size()-1;
+		size_t hole = world->hash & mask;
+		while(shard.slots[hole] != world){ hole = (hole+1) & mask; }
+		for(size_t i = (hole+1) & mask; shard.slots[i]; i = (i+1) & mask){
+			size_t home = shard.slots[i]->hash & mask;
+			if(((i-home) & mask) >= ((i-hole) & mask)){
+				shard.slots[hole] = shard.slots[i];
+				hole = i;
+			}
+		}
+		shard.slots[hole] = 0;
+	}
+	void WorldRegistry::clear(){
+		for(Shard &shard : shards){
+			for(World* world : shard.slots){
+				if(world){ world->~World(); }
+			}
+			for(std::pair<uint64_t*,size_t> &chunk : shard.chunks){ delete[] chunk.first; }
+			if(shard.spare.first){ delete[] shard.spare.first; }
+			shard.slots.assign(16,0);
+			shard.chunks.clear();
+			shard.spare = {0,0};
+			shard.next = 0;
+			shard.available = 0;
+			shard.count = 0;
 		}
-		return *exprPtr;
+		for(std::pair<const World*,Bits> &entry : cache){ entry.first = 0; }
+		cursor = 0;
+		pinned = 0;
+		count = 0;
+		scoped.clear();
+		scopes.clear();
 	}
 	
 	// World class
-	Groups World::groups;
-	World::World(idexpr_t k, Atoms &a) : Expression(k, ExpressionType::WORLD) {
-		atoms = std::move(a);
+	World::World(idexpr_t k, const uint64_t* w, uint32_t l, uint64_t h) : Expression(k, ExpressionType::WORLD), words(w), length(l), hash(h) {};
+	DeltaWorld::DeltaWorld(idexpr_t k, const uint64_t* w, uint32_t l, uint64_t h, const World* p, WorldRegistry* o, uint32_t c, uint32_t d) : World(k,w,l,h), parent(p), owner(o), toggleCount(c), depth(d) {};
+	uint64_t World::pack(const Atoms &atoms,Bits &bits){
+		uint64_t hash = 0;
+		for(idexpr_t atom : atoms){ set(bits,static_cast<Atom*>(context->exprs.at(atom))->index(),hash); }
+		return hash;
+	}
+	Atoms World::getAtoms() const {
+		Atoms atoms;
+		load();
+		for(size_t word = 0; word < length; word++){
+			for(uint64_t b = words[word]; b; b &= b-1){ atoms.insert(context->facts[(word<<6) | lowestBit(b)]); }
+		}
+		return atoms;
 	}
 	World* World::apply(Expression* action){
-		Atoms addList;
-		Atoms removeList;
+		Facts addList;
+		Facts removeList;
+		load();
 		action->apply(this,addList,removeList);
-		Atoms::iterator itRemove = removeList.begin();
-		for(Atoms::iterator itAtoms = atoms.begin(); itAtoms!=atoms.end(); ++itAtoms){
-			idexpr_t atom = *itAtoms;
-			while(itRemove!=removeList.end() && *itRemove < atom){
-				++itRemove;
-			}
-			if(itRemove==removeList.end() || atom < *itRemove){
-				addList.insert(atom);
-			}
+		Bits newBits(words,words+length);
+		uint64_t newHash = hash;
+		// Added atoms win over removed ones
+		for(idfact_t fact : removeList){ reset(newBits,fact,newHash); }
+		for(idfact_t fact : addList){ set(newBits,fact,newHash); }
+		return registerWorld(newBits,newHash,this);
+	}
+	World* World::apply(const CompiledAction &action){
+		load();
+		Bits newBits(words,words+length);
+		uint64_t newHash = hash;
+		// Conditions are tested on this world, they are tested again for the adds instead of keeping the triggered effects
+		for(idfact_t fact : action.removeList){ reset(newBits,fact,newHash); }
+		for(const ConditionalEffect &effect : action.conditional){
+			if(effect.isModeledBy(this)){ for(idfact_t fact : effect.removeList){ reset(newBits,fact,newHash); } }
 		}
-		idexpr_t key = iexprs[addList] | (ExpressionType::WORLD<<EXPRESSION_TYPE_OFFSET);
-		Expression** exprPtr = &exprs[key];
-		if(!*exprPtr){
-			*exprPtr = new World(key,addList);
+		for(idfact_t fact : action.addList){ set(newBits,fact,newHash); }
+		for(const ConditionalEffect &effect : action.conditional){
+			if(effect.isModeledBy(this)){ for(idfact_t fact : effect.addList){ set(newBits,fact,newHash); } }
 		}
-		return static_cast<World*>(*exprPtr);
+		return registerWorld(newBits,newHash,this);
 	}
 	bool World::operator==(const World &other) const{
-		return atoms==other.atoms;
+		if(hash!=other.hash || length!=other.length){ return false; }
+		load();
+		other.load();
+		return std::equal(words,words+length,other.words);
 	}
 	std::ostream& World::print(std::ostream& out) const {
 		out << "World: ";
-		for(idexpr_t a : atoms){ out << *exprs.at(a) << " "; }
+		for(idexpr_t a : getAtoms()){ out << *context->exprs.at(a) << " "; }
 		return out << std::endl;
 	}
 
 	// Constant class
 	Constant::Constant(idexpr_t k,idexpr_t c) : Expression(k ,ExpressionType::CONSTANT),constant(c) {};
 	std::ostream& Constant::print(std::ostream& out) const {
-		out << words.at(constant);
+		out << context->words.at(constant);
 		return out;
 	}
 	
 	// Variable class
 	Variable::Variable(idexpr_t k,idexpr_t v,idexpr_t g) : Expression(k, ExpressionType::VARIABLE),variable(v),group(g) {};
 	std::ostream& Variable::print(std::ostream& out) const {
-		out << words.at(variable);
+		out << context->words.at(variable);
 		if(group){
-			out << " - " << words.at(group);
+			out << " - " << context->words.at(group);
 		}
 		return out;
 	}
 	
 	// Logical Expression class
-	LogicalExpression::LogicalExpression(idexpr_t k,idtype_t t,Arguments &a) : Expression(k,t) { args = std::move(a); }
+	LogicalExpression::LogicalExpression(idexpr_t k,idtype_t t,ArgumentSpan a) : Expression(k,t), args(a) {};
 	Expression* LogicalExpression::substitute(idexpr_t o,idexpr_t n){
 		Expression* result = this;
 		idexpr_t newidExprs[0x100];
@@ -172,7 +487,7 @@ namespace Expressions{
 		int counter = 0;
 		int newCount = 0;
 		for(idexpr_t a : args){
-			Expression* expr = exprs.at(a)->substitute(o,n);
+			Expression* expr = context->exprs.at(a)->substitute(o,n);
 			if(expr->key  != a){
 				newidExprs[newCount] = expr->key;
 				pos[newCount++] = counter;
@@ -198,6 +513,36 @@ namespace Expressions{
 		}
 		return result;
 	}
+	Expression* LogicalExpression::ground(){
+		Arguments newArgs;
+		bool changed = false;
+		for(idexpr_t a : args){
+			Expression* expr = context->exprs.at(a)->ground();
+			changed = changed || expr->key != a;
+			newArgs.push_back(expr->key);
+		}
+		return changed?registerExpression(type,newArgs):this;
+	}
+	// Constant arguments decide a conjunction or disjunction when they are absorbing and are dropped otherwise
+	Expression* LogicalExpression::simplify(const std::set<idexpr_t> &fluents,const Atoms &initial){
+		Arguments newArgs;
+		bool changed = false;
+		for(idexpr_t a : args){
+			Expression* expr = context->exprs.at(a)->simplify(fluents,initial);
+			changed = changed || expr->key != a;
+			bool constant = (expr->type == ExpressionType::AND || expr->type == ExpressionType::OR) && static_cast<LogicalExpression*>(expr)->args.empty();
+			if(constant && (type == ExpressionType::AND || type == ExpressionType::OR)){
+				if(expr->type != type){ return expr; }
+				continue;
+			}
+			if(constant && type == ExpressionType::NOT){
+				Arguments none;
+				return registerExpression(expr->type == ExpressionType::AND?ExpressionType::OR:ExpressionType::AND,none);
+			}
+			newArgs.push_back(expr->key);
+		}
+		return changed?registerExpression(type,newArgs):this;
+	}
 	std::ostream& LogicalExpression::print(std::ostream& out) const {
 		unsigned int i=1;
 		out<<"(";
@@ -216,22 +561,39 @@ namespace Expressions{
 		for(idexpr_t arg : args){
 			if(i++){out << " ";}
 			if(addParenthesis){ out << '('; }
-			out << *exprs.at(arg);
+			out << *context->exprs.at(arg);
 			if(addParenthesis){ out << ')'; addParenthesis = false; }
 		}
 		return out<<")";
 	}
 	
 	// Atom class
-	Atom::Atom(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::ATOM,a) {};
+	Atom::Atom(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::ATOM,a), fact(NOFACT) {};
+	// Atoms get their fact index the first time they can be part of a world
+	idfact_t Atom::index(){
+		if(fact == NOFACT){
+			fact = context->facts.size();
+			context->facts.push_back(key);
+		}
+		return fact;
+	}
 	bool Atom::isModeledBy(World* world){
-		return world->atoms.find(key) != world->atoms.end();
+		return world->contains(fact);
 	}
 	bool Atom::isLaxModeledBy(World* maxWorld,World* minWorld){ return isModeledBy(maxWorld); }
-	void Atom::apply(World* world,Atoms &addList,Atoms &removeList){
-		addList.insert(key);
+	void Atom::apply(World* world,Facts &addList,Facts &removeList){
+		addList.push_back(index());
 	}
 	void Atom::applyPositive(Atoms &addList,Atoms &removeList){ addList.insert(key); }
+	void Atom::requiredAtoms(Atoms &positive,Atoms &negative){ positive.insert(key); }
+	bool Atom::compileCondition(Facts &positive,Facts &negative){
+		positive.push_back(index());
+		return true;
+	}
+	bool Atom::compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional){
+		addList.push_back(index());
+		return true;
+	}
 	Expression* Atom::substitute(idexpr_t o,idexpr_t n){
 		Expression* expr = this;
 		bool subs = false;
@@ -250,62 +612,105 @@ namespace Expressions{
 		}
 		return expr;
 	}
+	Expression* Atom::ground(){ return this; }
+	Expression* Atom::simplify(const std::set<idexpr_t> &fluents,const Atoms &initial){
+		if(fluents.count(args.front())){ return this; }
+		Arguments none;
+		return registerExpression(initial.count(key)?ExpressionType::AND:ExpressionType::OR,none);
+	}
 
 	// And class
-	And::And(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::AND,a) {};
+	And::And(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::AND,a) {};
 	bool And::isModeledBy(World* world){
 		for(idexpr_t a : args){
-			if(!exprs.at(a)->isModeledBy(world)){ return false; }
+			if(!context->exprs.at(a)->isModeledBy(world)){ return false; }
 		}
 		return true;
 	}
 	bool And::isLaxModeledBy(World* maxWorld,World* minWorld){
 		for(idexpr_t a : args){
-			if(!exprs.at(a)->isLaxModeledBy(maxWorld,minWorld)){ return false; }
+			if(!context->exprs.at(a)->isLaxModeledBy(maxWorld,minWorld)){ return false; }
+		}
+		return true;
+	}
+	void And::apply(World* world,Facts &addList,Facts &removeList){
+		for(idexpr_t a : args){
+			context->exprs.at(a)->apply(world,addList,removeList);
+		}
+	}
+	void And::applyPositive(Atoms &addList,Atoms &removeList){ for(idexpr_t a : args){ context->exprs.at(a)->applyPositive(addList,removeList); } }
+	void And::requiredAtoms(Atoms &positive,Atoms &negative){ for(idexpr_t a : args){ context->exprs.at(a)->requiredAtoms(positive,negative); } }
+	bool And::compileCondition(Facts &positive,Facts &negative){
+		for(idexpr_t a : args){
+			if(!context->exprs.at(a)->compileCondition(positive,negative)){ return false; }
 		}
 		return true;
 	}
-	void And::apply(World* world,Atoms &addList,Atoms &removeList){
+	bool And::compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional){
 		for(idexpr_t a : args){
-			exprs.at(a)->apply(world,addList,removeList);
+			if(!context->exprs.at(a)->compileEffect(addList,removeList,conditional)){ return false; }
 		}
+		return true;
 	}
-	void And::applyPositive(Atoms &addList,Atoms &removeList){ for(idexpr_t a : args){ exprs.at(a)->applyPositive(addList,removeList); } }
 	
 	// Or class
 	// Can't be applied, should throw error
-	Or::Or(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::OR,a) {};
+	Or::Or(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::OR,a) {};
 	bool Or::isModeledBy(World* world){
 		for(idexpr_t a : args){
-			if(exprs.at(a)->isModeledBy(world)){ return true; }
+			if(context->exprs.at(a)->isModeledBy(world)){ return true; }
 		}
 		return false;
 	}
 	bool Or::isLaxModeledBy(World* maxWorld,World* minWorld){
 		for(idexpr_t a : args){
-			if(exprs.at(a)->isLaxModeledBy(maxWorld,minWorld)){ return true; }
+			if(context->exprs.at(a)->isLaxModeledBy(maxWorld,minWorld)){ return true; }
 		}
 		return false;
 	}
 	
 	// Not class
-	Not::Not(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::NOT,a) {};
+	Not::Not(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::NOT,a) {};
 	bool Not::isModeledBy(World* world){
-		return !exprs.at(args.front())->isModeledBy(world);
+		return !context->exprs.at(args.front())->isModeledBy(world);
 	}
 	bool Not::isLaxModeledBy(World* maxWorld,World* minWorld){
-		return !exprs.at(args.front())->isLaxModeledBy(minWorld,maxWorld);
+		return !context->exprs.at(args.front())->isLaxModeledBy(minWorld,maxWorld);
+	}
+	void Not::apply(World* world,Facts &addList,Facts &removeList){
+		context->exprs.at(args.front())->apply(world,removeList,addList);
+	}
+	void Not::applyPositive(Atoms &addList,Atoms &removeList){ context->exprs.at(args.front())->applyPositive(removeList,addList); }
+	void Not::requiredAtoms(Atoms &positive,Atoms &negative){
+		if(context->exprs.type(args.front()) == ExpressionType::ATOM){ negative.insert(args.front()); }
+	}
+	// Only negated literals are conjunctions, an unsatisfiable condition requires the missing fact NOFACT
+	bool Not::compileCondition(Facts &positive,Facts &negative){
+		Expression* e = context->exprs.at(args.front());
+		switch(context->exprs.type(args.front())){
+			case ExpressionType::ATOM: return e->compileCondition(negative,positive);
+			case ExpressionType::NOT: return context->exprs.at(static_cast<Not*>(e)->args.front())->compileCondition(positive,negative);
+			case ExpressionType::EQUALS:
+				if(static_cast<Equals*>(e)->args.front()==static_cast<Equals*>(e)->args.back()){ positive.push_back(NOFACT); }
+				return true;
+		}
+		return false;
 	}
-	void Not::apply(World* world,Atoms &addList,Atoms &removeList){
-		exprs.at(args.front())->apply(world,removeList,addList);
+	bool Not::compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional){
+		if(context->exprs.type(args.front()) != ExpressionType::ATOM){ return false; }
+		Expression* e = context->exprs.at(args.front());
+		return e->compileEffect(removeList,addList,conditional);
 	}
-	void Not::applyPositive(Atoms &addList,Atoms &removeList){ exprs.at(args.front())->applyPositive(removeList,addList); }
 
 	// Equals class
 	// Can't be applied, should throw error
-	Equals::Equals(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::EQUALS,a) {};
+	Equals::Equals(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::EQUALS,a) {};
 	bool Equals::isModeledBy(World* world){ return args.front()==args.back(); }
 	bool Equals::isLaxModeledBy(World* maxWorld,World* minWorld){ return args.front()==args.back(); }
+	bool Equals::compileCondition(Facts &positive,Facts &negative){
+		if(args.front()!=args.back()){ positive.push_back(NOFACT); }
+		return true;
+	}
 	Expression* Equals::substitute(idexpr_t o,idexpr_t n){
 		Expression* expr = this;
 		bool subs = false;
@@ -327,77 +732,119 @@ namespace Expressions{
 	
 	// Imply class
 	// Can't be applied, should throw error (an applied Imply is a When)
-	Imply::Imply(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::IMPLY,a) {};
-	bool Imply::isModeledBy(World* world){ return !exprs.at(args.front())->isModeledBy(world) || exprs.at(args.back())->isModeledBy(world); }
-	bool Imply::isLaxModeledBy(World* maxWorld,World* minWorld){ return !exprs.at(args.front())->isLaxModeledBy(minWorld,maxWorld) || exprs.at(args.back())->isLaxModeledBy(maxWorld,minWorld); }
+	Imply::Imply(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::IMPLY,a) {};
+	bool Imply::isModeledBy(World* world){ return !context->exprs.at(args.front())->isModeledBy(world) || context->exprs.at(args.back())->isModeledBy(world); }
+	bool Imply::isLaxModeledBy(World* maxWorld,World* minWorld){ return !context->exprs.at(args.front())->isLaxModeledBy(minWorld,maxWorld) || context->exprs.at(args.back())->isLaxModeledBy(maxWorld,minWorld); }
 
 	// When class
 	// Can't be modeled, should throw error (a modeled When is an Imply)
-	When::When(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::WHEN,a) {};
-	void When::apply(World* world,Atoms &addList,Atoms &removeList){
-		if(exprs.at(args.front())->isModeledBy(world)){
-			exprs.at(args.back())->apply(world, addList, removeList);
+	When::When(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::WHEN,a) {};
+	void When::apply(World* world,Facts &addList,Facts &removeList){
+		if(context->exprs.at(args.front())->isModeledBy(world)){
+			context->exprs.at(args.back())->apply(world, addList, removeList);
+		}
+	}
+	void When::applyPositive(Atoms &addList,Atoms &removeList){ context->exprs.at(args.back())->applyPositive(addList,removeList); }
+	bool When::compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional){
+		ConditionalEffect effect;
+		std::vector<ConditionalEffect> nested;
+		if(!context->exprs.at(args.front())->compileCondition(effect.positive,effect.negative)){ return false; }
+		if(!context->exprs.at(args.back())->compileEffect(effect.addList,effect.removeList,nested) || !nested.empty()){ return false; }
+		// Effects that can never trigger are dropped
+		for(idfact_t fact : effect.positive){
+			if(fact == NOFACT){ return true; }
 		}
+		effect.sort();
+		conditional.push_back(effect);
+		return true;
 	}
-	void When::applyPositive(Atoms &addList,Atoms &removeList){ exprs.at(args.back())->applyPositive(addList,removeList); }
 
 	// Exists class
 	// Can't be applied, should throw error
-	Exists::Exists(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::EXISTS,a) {};
+	Exists::Exists(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::EXISTS,a) {};
 	bool Exists::isModeledBy(World* world){
-		Variable* v = static_cast<Variable*>(exprs.at(args.front()));
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
 		idexpr_t gid = v->group;
-		for(idexpr_t member : world->groups.at(gid)){
-			if(exprs.at(args.back())->substitute(v->variable,member)->isModeledBy(world)){ return true; }
+		for(idexpr_t member : context->groups.at(gid)){
+			if(context->exprs.at(args.back())->substitute(v->variable,member)->isModeledBy(world)){ return true; }
 		}
 		return false;
 	}
 	bool Exists::isLaxModeledBy(World* maxWorld,World* minWorld){
-		Variable* v = static_cast<Variable*>(exprs.at(args.front()));
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
 		idexpr_t gid = v->group;
-		for(idexpr_t member : maxWorld->groups.at(gid)){
-			if(exprs.at(args.back())->substitute(v->variable,member)->isLaxModeledBy(maxWorld,minWorld)){ return true; }
+		for(idexpr_t member : context->groups.at(gid)){
+			if(context->exprs.at(args.back())->substitute(v->variable,member)->isLaxModeledBy(maxWorld,minWorld)){ return true; }
 		}
 		return false;
 	}
+	// The disjunction of the body over the members
+	Expression* Exists::ground(){
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
+		Arguments bodies;
+		for(idexpr_t member : context->groups.at(v->group)){ bodies.push_back(context->exprs.at(args.back())->substitute(v->variable,member)->ground()->key); }
+		return registerExpression(ExpressionType::OR,bodies);
+	}
 	
 	// Forall class
-	Forall::Forall(idexpr_t k,Arguments &a) : LogicalExpression(k,ExpressionType::FORALL,a) {};
+	Forall::Forall(idexpr_t k,ArgumentSpan a) : LogicalExpression(k,ExpressionType::FORALL,a) {};
 	bool Forall::isModeledBy(World* world){
-		Variable* v = static_cast<Variable*>(exprs.at(args.front()));
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
 		idexpr_t gid = v->group;
-		for(idexpr_t member : world->groups.at(gid)){
-			if(!exprs.at(args.back())->substitute(v->variable,member)->isModeledBy(world)){ return false; }
+		for(idexpr_t member : context->groups.at(gid)){
+			if(!context->exprs.at(args.back())->substitute(v->variable,member)->isModeledBy(world)){ return false; }
 		}
 		return true;
 	}
 	bool Forall::isLaxModeledBy(World* maxWorld,World* minWorld){
-		Variable* v = static_cast<Variable*>(exprs.at(args.front()));
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
 		idexpr_t gid = v->group;
-		for(idexpr_t member : maxWorld->groups.at(gid)){
-			if(!exprs.at(args.back())->substitute(v->variable,member)->isLaxModeledBy(maxWorld,minWorld)){ return false; }
+		for(idexpr_t member : context->groups.at(gid)){
+			if(!context->exprs.at(args.back())->substitute(v->variable,member)->isLaxModeledBy(maxWorld,minWorld)){ return false; }
 		}
 		return true;
 	}
-	void Forall::apply(World* world,Atoms &addList,Atoms &removeList){
-		Variable* v = static_cast<Variable*>(exprs.at(args.front()));
+	void Forall::apply(World* world,Facts &addList,Facts &removeList){
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
 		idexpr_t gid = v->group;
-		for(idexpr_t member : world->groups.at(gid)){
-			exprs.at(args.back())->substitute(v->variable,member)->apply(world,addList,removeList);
+		for(idexpr_t member : context->groups.at(gid)){
+			context->exprs.at(args.back())->substitute(v->variable,member)->apply(world,addList,removeList);
 		}
 	}
+	bool Forall::compileCondition(Facts &positive,Facts &negative){
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
+		for(idexpr_t member : context->groups.at(v->group)){
+			if(!context->exprs.at(args.back())->substitute(v->variable,member)->compileCondition(positive,negative)){ return false; }
+		}
+		return true;
+	}
+	bool Forall::compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional){
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
+		for(idexpr_t member : context->groups.at(v->group)){
+			if(!context->exprs.at(args.back())->substitute(v->variable,member)->compileEffect(addList,removeList,conditional)){ return false; }
+		}
+		return true;
+	}
 	void Forall::applyPositive(Atoms &addList,Atoms &removeList){
-		Variable* v = static_cast<Variable*>(exprs.at(args.front()));
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
 		idexpr_t gid = v->group;
-		for(idexpr_t member : World::groups.at(gid)){
-			exprs.at(args.back())->substitute(v->variable,member)->applyPositive(addList,removeList);
+		for(idexpr_t member : context->groups.at(gid)){
+			context->exprs.at(args.back())->substitute(v->variable,member)->applyPositive(addList,removeList);
 		}
 	}
+	// The conjunction of the body over the members, as a condition or as an effect
+	Expression* Forall::ground(){
+		Variable* v = static_cast<Variable*>(context->exprs.at(args.front()));
+		Arguments bodies;
+		for(idexpr_t member : context->groups.at(v->group)){ bodies.push_back(context->exprs.at(args.back())->substitute(v->variable,member)->ground()->key); }
+		return registerExpression(ExpressionType::AND,bodies);
+	}
 	
 	World* make_world(std::set<std::string> a,std::map<std::string,std::set<std::string>> g){
 		Atoms atoms;
-		Expression::words[0] = "";
-		World::groups.clear();
+		Bits bits;
+		Expression::context->words[0] = "";
+		Expression::context->groups.clear();
 		for(std::string s : a){
 			Expression* e = make_expression(s);
 			atoms.insert(e->key);
@@ -408,17 +855,247 @@ namespace Expressions{
 				gKey = Expression::registerWord(group.first);
 				
 			}
-			Atoms* members = &World::groups[gKey];
+			Atoms* members = &Expression::context->groups[gKey];
 			for(const std::string &s : group.second){
 				members->insert(Expression::registerWord(s));
 			}
 		}
-		idexpr_t key = Expression::iexprs[atoms] | (ExpressionType::WORLD<<EXPRESSION_TYPE_OFFSET);
-		Expression** exprPtr = &Expression::exprs[key];
-		if(!*exprPtr){
-			*exprPtr = new World(key,atoms);
+		uint64_t hash = World::pack(atoms,bits);
+		return Expression::registerWorld(bits,hash);
+	}
+	World* make_world(const Atoms &atoms){
+		Bits bits;
+		uint64_t hash = World::pack(atoms,bits);
+		return Expression::registerWorld(bits,hash);
+	}
+	
+	// Selects the registry of new worlds (0 for the default one), returns the previous one
+	WorldRegistry* use_registry(WorldRegistry* registry){
+		WorldRegistry* previous = Expression::context->registry;
+		Expression::context->registry = registry?registry:&Expression::context->worlds;
+		return previous;
+	}
+	
+	// Selects the context of the calling thread (0 for the global one), returns the previous one
+	Context* use_context(Context* context){
+		Context* previous = Expression::context;
+		Expression::context = context?context:&Expression::global;
+		return previous;
+	}
+	
+	// Assigns fact indexes to the atoms, so the facts reachable after grounding are packed at the start of the worlds
+	void index_facts(const Atoms &atoms){
+		for(idexpr_t atom : atoms){ static_cast<Atom*>(Expression::context->exprs.at(atom))->index(); }
+	}
+	
+	// Forgets the fact indexes so a new problem packs its own facts from the start, worlds built before can't be read after
+	void reset_facts(){
+		for(idexpr_t atom : Expression::context->facts){ static_cast<Atom*>(Expression::context->exprs.at(atom))->fact = NOFACT; }
+		Expression::context->facts.clear();
+	}
+	
+	// Mutex groups by invariant synthesis over the grounded actions. A candidate is a set of parts, a predicate with the position
+	// of its counted argument (0 counts none), and the facts of its parts with the same remaining arguments form a group. The
+	// candidate holds when the initial world has at most one fact of every group and every action adding a fact of a group
+	// also requires and deletes one of it; the first action that breaks it suggests the candidates extended with the facts it
+	// requires and deletes. Candidates start from every argument of the predicates the actions add
+	std::vector<Facts> mutex_groups(const World* initial,const std::vector<std::pair<const CompiledAction*,Expression*>> &actions){
+		using Part = std::pair<idexpr_t,size_t>;
+		using Candidate = std::vector<Part>;
+		const size_t MAX_CANDIDATES = 256;
+		auto atom = [](idfact_t fact){ return static_cast<Atom*>(Expression::context->exprs.at(Expression::context->facts[fact])); };
+		auto parameters = [&atom](idfact_t fact,size_t counted){
+			const ArgumentSpan &args = atom(fact)->args;
+			Arguments key;
+			for(size_t i = 1; i < args.size(); i++){
+				if(i != counted){ key.push_back(args[i]); }
+			}
+			return key;
+		};
+		// Adds of every action, the facts it requires and deletes, and the adds it may make without them (conditional effects
+		// or effects and preconditions that couldn't be compiled)
+		std::vector<Facts> adds(actions.size()), consumed(actions.size()), unbalanced(actions.size());
+		for(size_t i = 0; i < actions.size(); i++){
+			const CompiledAction* compiled = actions[i].first;
+			if(compiled->flatEffect){
+				adds[i] = compiled->addList;
+				for(const ConditionalEffect &effect : compiled->conditional){ unbalanced[i].insert(unbalanced[i].end(),effect.addList.begin(),effect.addList.end()); }
+			}else{
+				Atoms addList;
+				Atoms removeList;
+				actions[i].second->applyPositive(addList,removeList);
+				for(idexpr_t a : addList){ unbalanced[i].push_back(static_cast<Atom*>(Expression::context->exprs.at(a))->index()); }
+			}
+			if(!compiled->flatPrecondition){
+				unbalanced[i].insert(unbalanced[i].end(),adds[i].begin(),adds[i].end());
+				adds[i].clear();
+			}
+			for(idfact_t fact : compiled->removeList){
+				if(std::binary_search(compiled->positive.begin(),compiled->positive.end(),fact)){ consumed[i].push_back(fact); }
+			}
+		}
+		std::map<idexpr_t,Facts> predicates;
+		std::set<idexpr_t> fluents;
+		for(idfact_t fact = 0; fact < Expression::context->facts.size(); fact++){ predicates[atom(fact)->args.front()].push_back(fact); }
+		for(size_t i = 0; i < actions.size(); i++){
+			for(const Facts* list : {&adds[i],&unbalanced[i]}){
+				for(idfact_t fact : *list){ fluents.insert(atom(fact)->args.front()); }
+			}
+		}
+		Facts init;
+		initial->load();
+		for(size_t word = 0; word < initial->length; word++){
+			for(uint64_t b = initial->words[word]; b; b &= b-1){ init.push_back((word<<6) | lowestBit(b)); }
+		}
+		std::vector<Candidate> queue;
+		std::set<Candidate> seen;
+		for(idexpr_t predicate : fluents){
+			for(size_t counted = 1; counted < atom(predicates[predicate].front())->args.size(); counted++){
+				queue.push_back({{predicate,counted}});
+				seen.insert(queue.back());
+			}
+		}
+		std::vector<Facts> groups;
+		std::vector<int> group(Expression::context->facts.size());
+		for(size_t next = 0; next < queue.size() && next < MAX_CANDIDATES; next++){
+			Candidate candidate = queue[next];
+			std::map<Arguments,int> ids;
+			std::vector<Arguments> keys;
+			std::vector<Facts> members;
+			std::fill(group.begin(),group.end(),-1);
+			for(const Part &part : candidate){
+				for(idfact_t fact : predicates[part.first]){
+					Arguments key = parameters(fact,part.second);
+					std::pair<std::map<Arguments,int>::iterator,bool> id = ids.insert({key,(int)members.size()});
+					if(id.second){
+						keys.push_back(key);
+						members.emplace_back();
+					}
+					group[fact] = id.first->second;
+					members[group[fact]].push_back(fact);
+				}
+			}
+			bool holds = true;
+			std::vector<unsigned int> count(members.size(),0);
+			for(idfact_t fact : init){
+				if(group[fact] >= 0 && ++count[group[fact]] > 1){ holds = false; }
+			}
+			for(size_t i = 0; holds && i < actions.size(); i++){
+				for(idfact_t fact : unbalanced[i]){
+					if(group[fact] >= 0){ holds = false; }
+				}
+				std::vector<int> added;
+				for(idfact_t fact : adds[i]){
+					if(group[fact] >= 0){ added.push_back(group[fact]); }
+				}
+				std::sort(added.begin(),added.end());
+				if(std::adjacent_find(added.begin(),added.end()) != added.end()){ holds = false; }
+				for(size_t a = 0; holds && a < added.size(); a++){
+					bool balanced = false;
+					for(idfact_t fact : consumed[i]){
+						if(group[fact] == added[a]){ balanced = true; }
+					}
+					if(balanced){ continue; }
+					holds = false;
+					for(idfact_t fact : consumed[i]){
+						idexpr_t predicate = atom(fact)->args.front();
+						bool known = false;
+						for(const Part &part : candidate){
+							if(part.first == predicate){ known = true; }
+						}
+						if(known){ continue; }
+						for(size_t counted = 0; counted < atom(fact)->args.size(); counted++){
+							if(parameters(fact,counted) != keys[added[a]]){ continue; }
+							Candidate extended = candidate;
+							extended.push_back({predicate,counted});
+							std::sort(extended.begin(),extended.end());
+							if(seen.insert(extended).second){ queue.push_back(extended); }
+						}
+					}
+				}
+			}
+			if(!holds){ continue; }
+			for(const Facts &facts : members){
+				if(facts.size() > 1){ groups.push_back(facts); }
+			}
 		}
-		return (World*)(*exprPtr);
+		return groups;
+	}
+	
+	// Finite domain class
+	FiniteDomain::FiniteDomain() : bit(0), length(0) {};
+	// Groups are taken largest first, each with the facts the previous ones left
+	FiniteDomain::FiniteDomain(const std::vector<Facts> &groups) : bit(0), length(0) {
+		size_t count = Expression::context->facts.size();
+		variable.assign(count,UINT32_MAX);
+		value.assign(count,0);
+		std::vector<const Facts*> order;
+		for(const Facts &group : groups){ order.push_back(&group); }
+		std::stable_sort(order.begin(),order.end(),[](const Facts* a,const Facts* b){ return a->size() > b->size(); });
+		for(const Facts* group : order){
+			Facts left;
+			for(idfact_t fact : *group){
+				if(fact < count && variable[fact] == UINT32_MAX){ left.push_back(fact); }
+			}
+			if(left.size() > 1){ add(left); }
+		}
+		for(idfact_t fact = 0; fact < count; fact++){
+			if(variable[fact] == UINT32_MAX){ add({fact}); }
+		}
+		length = (bit+63)>>6;
+	}
+	// Variables never straddle two words
+	void FiniteDomain::add(const Facts &group){
+		uint32_t bits = 1;
+		while((1ULL<<bits) <= group.size()){ bits++; }
+		if((bit&63) + bits > 64){ bit = (bit|63) + 1; }
+		for(size_t i = 0; i < group.size(); i++){
+			variable[group[i]] = variables.size();
+			value[group[i]] = i+1;
+		}
+		variables.push_back(group);
+		offset.push_back(bit);
+		width.push_back(bits);
+		bit += bits;
+	}
+	void FiniteDomain::pack(const uint64_t* words,size_t size,Bits &packed) const{
+		packed.assign(length,0);
+		for(size_t word = 0; word < size; word++){
+			for(uint64_t b = words[word]; b; b &= b-1){
+				idfact_t fact = (word<<6) | lowestBit(b);
+				uint32_t o = offset[variable[fact]];
+				packed[o>>6] |= (uint64_t)value[fact]<<(o&63);
+			}
+		}
+		while(!packed.empty() && !packed.back()){ packed.pop_back(); }
+	}
+	void FiniteDomain::unpack(const uint64_t* packed,size_t size,Bits &bits) const{
+		bits.clear();
+		for(size_t v = 0; v < variables.size() && (offset[v]>>6) < size; v++){
+			uint64_t val = (packed[offset[v]>>6]>>(offset[v]&63)) & ((1ULL<<width[v])-1);
+			if(!val){ continue; }
+			idfact_t fact = variables[v][val-1];
+			if((fact>>6) >= bits.size()){ bits.resize((fact>>6)+1,0); }
+			bits[fact>>6] |= 1ULL<<(fact&63);
+		}
+	}
+	
+	// Conditional effect class
+	void ConditionalEffect::sort(){
+		for(Facts* facts : {&positive,&negative,&addList,&removeList}){
+			std::sort(facts->begin(),facts->end());
+			facts->erase(std::unique(facts->begin(),facts->end()),facts->end());
+		}
+	}
+	
+	// Compiled action class
+	CompiledAction::CompiledAction() : flatPrecondition(false), flatEffect(false) {};
+	CompiledAction::CompiledAction(Expression* precondition,Expression* effect){
+		flatPrecondition = precondition && precondition->compileCondition(positive,negative);
+		flatEffect = effect && effect->compileEffect(addList,removeList,conditional);
+		if(!flatPrecondition){ positive.clear(); negative.clear(); }
+		if(!flatEffect){ addList.clear(); removeList.clear(); conditional.clear(); }
+		sort();
 	}
 	
 	// Probably can be optimized, wrote it half drunk
@@ -508,14 +1185,13 @@ namespace Expressions{
 		return Expression::registerWord(s);
 	}
 	
+	inline Expression* get_expression(idexpr_t key){
+		return Expression::context->exprs.at(key);
+	}
+	
+	// Releases everything registered in the context of the calling thread
 	void releaseMemory(){
-		Expression::words.clear();
-		for(const std::pair<idexpr_t,Expression*>& exp : Expression::exprs){
-			delete exp.second;
-		}
-		Expression::exprs.clear();
-		Expression::iwords.clear();
-		Expression::iexprs.clear();
+		Expression::context->clear();
 	}
 	
 };
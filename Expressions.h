@@ -2,13 +2,21 @@
 #define EXPRESSIONS_H
 
 #include "ExpressionsDictionary.cpp"
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <new>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace Expressions{
 	// Class, type and constants definitions
@@ -26,21 +34,139 @@ namespace Expressions{
 	class Exists;
 	class Forall;
 	class World;
+	class ConditionalEffect;
+	class CompiledAction;
+	class WorldRegistry;
+	class FiniteDomain;
+	class ExpressionTable;
+	class Context;
 	
 	using idexpr_t = uint64_t;
 	using idtype_t = uint64_t;
+	using idfact_t = uint32_t;
 	using WordMap = std::map<idexpr_t,std::string>;
-	using ExpressionMap = std::map<idexpr_t,Expression*>;
+	using ExpressionMap = ExpressionTable;
 	using ReverseWordMap = ExpressionsDictionary::Trie<const char,idexpr_t>;
 	using ReverseExpressionMap = ExpressionsDictionary::Trie<idexpr_t,idexpr_t>;
 	using Arguments = std::vector<idexpr_t>;
 	using Atoms = std::set<idexpr_t>;
 	using Groups = std::map<idexpr_t,Atoms>;
+	// Facts are dense indexes of the atoms that appear in worlds, a world stores one bit per fact
+	using Facts = std::vector<idfact_t>;
+	using Bits = std::vector<uint64_t>;
+	const idfact_t NOFACT = UINT32_MAX;
+	
+	// Bit helpers over the words of a world
+	inline unsigned int popcount(uint64_t word){
+#if defined(_MSC_VER)
+		return (unsigned int)__popcnt64(word);
+#else
+		return __builtin_popcountll(word);
+#endif
+	}
+	inline unsigned int lowestBit(uint64_t word){
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index,word);
+		return index;
+#else
+		return __builtin_ctzll(word);
+#endif
+	}
+	// Zobrist key of a fact, the hash of a world is the xor of the keys of its facts
+	inline uint64_t zobrist(idfact_t fact){
+		uint64_t z = (fact + 1) * 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+	
+	// Objects of one type built in chunks of CHUNK, destroyed and released together by clear
+	template <typename T> class Arena{
+		protected:
+			std::vector<T*> chunks;
+			size_t used;
+		public:
+			static const size_t CHUNK = 256;
+			Arena() : used(CHUNK) {};
+			~Arena(){ clear(); }
+			template <typename... A> T* make(A&&... args){
+				if(used == CHUNK){
+					chunks.push_back(static_cast<T*>(::operator new(CHUNK*sizeof(T))));
+					used = 0;
+				}
+				return new(chunks.back()+used++) T(std::forward<A>(args)...);
+			}
+			void clear(){
+				for(size_t chunk = 0; chunk < chunks.size(); chunk++){
+					size_t count = chunk+1 < chunks.size()?CHUNK:used;
+					for(size_t i = 0; i < count; i++){ chunks[chunk][i].~T(); }
+					::operator delete(chunks[chunk]);
+				}
+				chunks.clear();
+				used = CHUNK;
+			}
+	};
+	
+	// Arguments of a logical expression, a run of identifiers kept by the ArgumentPool of its context
+	class ArgumentSpan{
+		protected:
+			const idexpr_t* first;
+			uint32_t length;
+		public:
+			ArgumentSpan() : first(0), length(0) {};
+			ArgumentSpan(const idexpr_t* f,uint32_t l) : first(f), length(l) {};
+			inline const idexpr_t* begin() const { return first; }
+			inline const idexpr_t* end() const { return first+length; }
+			inline size_t size() const { return length; }
+			inline bool empty() const { return !length; }
+			inline idexpr_t front() const { return first[0]; }
+			inline idexpr_t back() const { return first[length-1]; }
+			inline idexpr_t operator[](size_t i) const { return first[i]; }
+	};
+	
+	// Runs of identifiers copied into chunks of CHUNK (a longer run gets a chunk of its own), they don't move until clear
+	// releases them together
+	class ArgumentPool{
+		protected:
+			std::vector<idexpr_t*> chunks;
+			size_t used;
+		public:
+			static const size_t CHUNK = 4096;
+			ArgumentPool() : used(CHUNK) {};
+			~ArgumentPool(){ clear(); }
+			ArgumentPool(const ArgumentPool&) = delete;
+			ArgumentPool& operator=(const ArgumentPool&) = delete;
+			ArgumentSpan store(const Arguments &args);
+			void clear();
+	};
+	
+	// Expressions by the unique identifier in the low bits of their key (words and expressions share the identifiers), with
+	// their type kept beside them
+	class ExpressionTable{
+		protected:
+			std::vector<Expression*> entries;
+			std::vector<idtype_t> types;
+		public:
+			static const idexpr_t MASK = 0xFFFFFFFFULL;
+			inline Expression* at(idexpr_t key) const { return entries[key & MASK]; }
+			inline idtype_t type(idexpr_t key) const { return types[key & MASK]; }
+			inline Expression* find(idexpr_t key) const { return (key & MASK) < entries.size()?entries[key & MASK]:0; }
+			void insert(Expression* expr);
+			void clear();
+	};
 	
 	World* make_world(std::set<std::string> atoms,std::map<std::string,std::set<std::string>> groups);
+	World* make_world(const Atoms &atoms);
+	WorldRegistry* use_registry(WorldRegistry* registry);
+	Context* use_context(Context* context);
+	void index_facts(const Atoms &atoms);
+	void reset_facts();
+	std::vector<Facts> mutex_groups(const World* initial,const std::vector<std::pair<const CompiledAction*,Expression*>> &actions);
 	Expression* make_expression(std::string expression);
 	Expression* make_substitution(Expression* original,const std::string &oldValue,const std::string &newValue);
 	inline idexpr_t get_idword(const std::string& s);
+	inline Expression* get_expression(idexpr_t key);
 	
 	extern const char* andStr;
 	extern const char* orStr;
@@ -53,14 +179,14 @@ namespace Expressions{
 	
 	class Expression{
 		protected:
-			static WordMap words;
-			static ReverseWordMap iwords;
-			static ExpressionMap exprs;
-			static ReverseExpressionMap iexprs;
+			// Context of the calling thread, the global one until use_context selects another
+			static Context global;
+			static thread_local Context* context;
 			static inline idexpr_t registerWord(const std::string &str);
 			static inline Expression* registerConstant(const std::string &cnt);
 			static inline Expression* registerVariable(const std::string &var,const std::string &grp);
 			static inline Expression* registerExpression(idtype_t type, Arguments &args);
+			static inline World* registerWorld(Bits &bits,uint64_t hash,const World* parent=0);
 		public:
 			idexpr_t key;
 			idtype_t type;
@@ -69,27 +195,84 @@ namespace Expressions{
 			virtual ~Expression();
 			virtual bool isModeledBy(World* world);
 			virtual bool isLaxModeledBy(World* maxWorld,World* minWorld);
-			virtual void apply(World* world,Atoms &addList,Atoms &removeList);
+			virtual void apply(World* world,Facts &addList,Facts &removeList);
 			virtual void applyPositive(Atoms &addList,Atoms &removeList);
+			// Atoms every world modeling the expression holds (positive) and lacks (negative), a relaxation of the condition that
+			// ignores what isn't a conjunction of literals
+			virtual void requiredAtoms(Atoms &positive,Atoms &negative);
+			// Replaces the atoms of static predicates (not in fluents) by their value in the initial atoms, true is an empty And
+			// and false an empty Or, and folds the connectives they decide
+			virtual Expression* simplify(const std::set<idexpr_t> &fluents,const Atoms &initial);
+			// Lower grounded expressions to fact lists, false when the expression isn't a conjunction of literals (or of effects)
+			virtual bool compileCondition(Facts &positive,Facts &negative);
+			virtual bool compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional);
 			virtual Expression* substitute(idexpr_t o,idexpr_t n);
+			// Expands the quantifiers over the members of their group in the context, the result has none left
+			virtual Expression* ground();
 			virtual std::ostream& print(std::ostream& out) const;
 			friend std::ostream& operator<<(std::ostream &out, Expression &e);
 			friend Expression* make_expression(std::string expression);
 			friend World* make_world(std::set<std::string> atoms,std::map<std::string,std::set<std::string>> groups);
+			friend World* make_world(const Atoms &atoms);
+			friend WorldRegistry* use_registry(WorldRegistry* registry);
+			friend Context* use_context(Context* context);
 			friend inline idexpr_t get_idword(const std::string& s);
+			friend inline Expression* get_expression(idexpr_t key);
+			friend void index_facts(const Atoms &atoms);
+			friend void reset_facts();
+			friend std::vector<Facts> mutex_groups(const World* initial,const std::vector<std::pair<const CompiledAction*,Expression*>> &actions);
+			friend class FiniteDomain;
 			friend void releaseMemory();
 	};
 	
 	class World : public Expression{
 		public:
-			static Groups groups;
-			Atoms atoms;
-			World(idexpr_t k, Atoms &a);
+			// Bits of the facts that hold, stored right after the world by its registry; trailing zero words are trimmed so equal
+			// worlds have equal words. Worlds of a delta registry may hold no words until load rebuilds them
+			mutable const uint64_t* words;
+			uint32_t length;
+			uint64_t hash;
+			World(idexpr_t k, const uint64_t* w, uint32_t l, uint64_t h);
+			inline void load() const;
+			inline uint64_t word(size_t i) const { return i < length?words[i]:0; }
+			inline bool contains(idfact_t fact) const { return (fact>>6) < length && (words[fact>>6]>>(fact&63))&1; }
+			// Packs the atoms into bits, returns their hash
+			static uint64_t pack(const Atoms &atoms,Bits &bits);
+			// Set and reset keep the hash of the bits up to date
+			static inline void set(Bits &b,idfact_t fact,uint64_t &h){
+				if((fact>>6) >= b.size()){ b.resize((fact>>6)+1,0); }
+				if(!((b[fact>>6]>>(fact&63))&1)){
+					b[fact>>6] |= 1ULL<<(fact&63);
+					h ^= zobrist(fact);
+				}
+			}
+			static inline void reset(Bits &b,idfact_t fact,uint64_t &h){
+				if((fact>>6) < b.size() && (b[fact>>6]>>(fact&63))&1){
+					b[fact>>6] &= ~(1ULL<<(fact&63));
+					h ^= zobrist(fact);
+				}
+			}
+			Atoms getAtoms() const;
 			World* apply(Expression* action);
+			World* apply(const CompiledAction &action);
 			bool operator==(const World &other) const;
 			std::ostream& print(std::ostream& out) const;
 	};
 	
+	// World of a delta registry, keeps the facts toggled from its parent right after it; every snapshotInterval levels (or when
+	// the toggles outweigh the bits) the full words are kept instead and the depth starts again from 0. Snapshots of an
+	// encoded registry have no parent and keep toggleCount packed words instead
+	class DeltaWorld : public World{
+		public:
+			const World* parent;
+			WorldRegistry* owner;
+			uint32_t toggleCount;
+			uint32_t depth;
+			DeltaWorld(idexpr_t k, const uint64_t* w, uint32_t l, uint64_t h, const World* p, WorldRegistry* o, uint32_t c, uint32_t d);
+			inline const idfact_t* toggles() const { return (const idfact_t*)(this+1); }
+			inline const uint64_t* packed() const { return (const uint64_t*)(this+1); }
+	};
+	
 	class Constant : public Expression{
 		public:
 			idexpr_t constant;
@@ -107,34 +290,46 @@ namespace Expressions{
 	
 	class LogicalExpression : public Expression{
 		public:
-			Arguments args;
-			LogicalExpression(idexpr_t k,idtype_t t,Arguments &a);
+			ArgumentSpan args;
+			LogicalExpression(idexpr_t k,idtype_t t,ArgumentSpan a);
 			virtual Expression* substitute(idexpr_t o,idexpr_t n);
+			virtual Expression* ground();
+			virtual Expression* simplify(const std::set<idexpr_t> &fluents,const Atoms &initial);
 			std::ostream& print(std::ostream& out) const;
 	};
 	
 	class Atom : public LogicalExpression{
 		public:
-			Atom(idexpr_t k,Arguments &a);
+			idfact_t fact;
+			Atom(idexpr_t k,ArgumentSpan a);
+			idfact_t index();
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
-			void apply(World* world,Atoms &addList,Atoms &removeList);
+			void apply(World* world,Facts &addList,Facts &removeList);
 			void applyPositive(Atoms &addList,Atoms &removeList);
+			void requiredAtoms(Atoms &positive,Atoms &negative);
+			bool compileCondition(Facts &positive,Facts &negative);
+			bool compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional);
 			Expression* substitute(idexpr_t o,idexpr_t n);
+			Expression* ground();
+			Expression* simplify(const std::set<idexpr_t> &fluents,const Atoms &initial);
 	};
 	
 	class And : public LogicalExpression{
 		public:
-			And(idexpr_t k,Arguments &a);
+			And(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
-			void apply(World* world,Atoms &addList,Atoms &removeList);
+			void apply(World* world,Facts &addList,Facts &removeList);
 			void applyPositive(Atoms &addList,Atoms &removeList);
+			void requiredAtoms(Atoms &positive,Atoms &negative);
+			bool compileCondition(Facts &positive,Facts &negative);
+			bool compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional);
 	};
 	
 	class Or : public LogicalExpression{
 		public:
-			Or(idexpr_t k,Arguments &a);
+			Or(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
 			// Can't be applied, should throw error
@@ -142,25 +337,29 @@ namespace Expressions{
 	
 	class Not : public LogicalExpression{
 		public:
-			Not(idexpr_t k,Arguments &a);
+			Not(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
-			void apply(World* world,Atoms &addList,Atoms &removeList);
+			void apply(World* world,Facts &addList,Facts &removeList);
 			void applyPositive(Atoms &addList,Atoms &removeList);
+			void requiredAtoms(Atoms &positive,Atoms &negative);
+			bool compileCondition(Facts &positive,Facts &negative);
+			bool compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional);
 	};
 	
 	class Equals : public LogicalExpression{
 		public:
-			Equals(idexpr_t k,Arguments &a);
+			Equals(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
+			bool compileCondition(Facts &positive,Facts &negative);
 			// Can't be applied, should throw error
 			Expression* substitute(idexpr_t o,idexpr_t n);
 	};
 	
 	class Imply : public LogicalExpression{
 		public:
-			Imply(idexpr_t k,Arguments &a);
+			Imply(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
 			// Can't be applied, should throw error (an applied Imply is a When)
@@ -168,27 +367,175 @@ namespace Expressions{
 	
 	class When : public LogicalExpression{
 		public:
-			When(idexpr_t k,Arguments &a);
+			When(idexpr_t k,ArgumentSpan a);
 			// Can't be modeled, should throw error (a modeled When is an Imply)
-			void apply(World* world,Atoms &addList,Atoms &removeList);
+			void apply(World* world,Facts &addList,Facts &removeList);
 			void applyPositive(Atoms &addList,Atoms &removeList);
+			bool compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional);
 	};
 	
 	class Exists : public LogicalExpression{
 		public:
-			Exists(idexpr_t k,Arguments &a);
+			Exists(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
+			Expression* ground();
 			// Can't be applied, should throw error
 	};
 	
 	class Forall : public LogicalExpression{
 		public:
-			Forall(idexpr_t k,Arguments &a);
+			Forall(idexpr_t k,ArgumentSpan a);
 			bool isModeledBy(World* world);
 			bool isLaxModeledBy(World* maxWorld,World* minWorld);
-			void apply(World* world,Atoms &addList,Atoms &removeList);
+			void apply(World* world,Facts &addList,Facts &removeList);
 			void applyPositive(Atoms &addList,Atoms &removeList);
+			bool compileCondition(Facts &positive,Facts &negative);
+			bool compileEffect(Facts &addList,Facts &removeList,std::vector<ConditionalEffect> &conditional);
+			Expression* ground();
+	};
+	
+	// Worlds of a search: an open addressing table found by hash and confirmed on the full bits, with the worlds and their
+	// words allocated in chunks that are released together. New worlds go to the registry selected with use_registry.
+	// With a snapshotInterval the worlds are stored as DeltaWorld, their words are rebuilt by load into a ring of CACHE buffers
+	// and dropped again when the buffer is reused; pin keeps the world being expanded out of the ring. An encoding given to
+	// encode stores the later snapshots packed in its finite domain, rebuilt by load the same way
+	// The table is split in SHARDS by the high bits of the hash, each with its own lock and chunks, so full worlds can be found
+	// and registered from several threads; the ring of a snapshotInterval or an encoding is for a single thread
+	// A depth first search that drops worlds in the reverse order it registers them opens a scope with mark before expanding
+	// a world and closes it with release once done with the successors, which frees every world registered in the scope
+	class WorldRegistry{
+		protected:
+			static const size_t SHARDS = 16;
+			class Shard{
+				public:
+					std::mutex mutex;
+					std::vector<World*> slots;
+					// Chunks with their size in words, the last released one is kept as spare
+					std::vector<std::pair<uint64_t*,size_t>> chunks;
+					std::pair<uint64_t*,size_t> spare;
+					char* next;
+					size_t available;
+					size_t count;
+					Shard() : slots(16,0), spare(0,0), next(0), available(0), count(0) {};
+			};
+			// World registered inside a scope, with the allocation of its shard before it
+			class Registered{
+				public:
+					World* world;
+					char* next;
+					size_t available;
+					size_t chunks;
+			};
+			Shard shards[SHARDS];
+			std::atomic<size_t> count;
+			std::vector<std::pair<const World*,Bits>> cache;
+			size_t cursor;
+			const World* pinned;
+			const FiniteDomain* encoding;
+			std::vector<Registered> scoped;
+			std::vector<size_t> scopes;
+			void grow(Shard &shard);
+			void erase(Shard &shard,const World* world);
+			void* allocate(Shard &shard,size_t bytes);
+			World* insert(Shard &shard,Bits &bits,uint64_t hash,const World* parent);
+			Bits& buffer(const World* world);
+		public:
+			static const size_t CHUNK = 1<<18;
+			static const size_t CACHE = 1024;
+			const unsigned int snapshotInterval;
+			WorldRegistry(unsigned int snapshotInterval=0);
+			~WorldRegistry();
+			World* find(Bits &bits,uint64_t hash,const World* parent=0);
+			void materialize(const World* world);
+			void pin(const World* world);
+			void encode(const FiniteDomain* e);
+			void mark();
+			void release();
+			size_t size() const;
+			void clear();
+	};
+	
+	inline void World::load() const {
+		if(!words){ static_cast<const DeltaWorld*>(this)->owner->materialize(this); }
+	}
+	
+	// Finite domain (SAS+) encoding of the facts: every mutex group is a variable whose value is the fact of the group that holds
+	// (1 based, 0 when none does), packed in the bits its domain needs; facts outside the groups are variables of their own.
+	// The encoding covers the facts indexed when it is built
+	class FiniteDomain{
+		protected:
+			uint32_t bit;
+			void add(const Facts &group);
+		public:
+			std::vector<Facts> variables;
+			std::vector<uint32_t> variable;
+			std::vector<uint32_t> value;
+			std::vector<uint32_t> offset;
+			std::vector<uint32_t> width;
+			// Words of a packed world, trailing zero words are trimmed as in the worlds
+			uint32_t length;
+			FiniteDomain();
+			FiniteDomain(const std::vector<Facts> &groups);
+			void pack(const uint64_t* words,size_t size,Bits &packed) const;
+			void unpack(const uint64_t* packed,size_t size,Bits &bits) const;
+	};
+	
+	// Everything registered while planning a problem: words, expressions, facts, the groups of the quantifiers and the worlds.
+	// Every thread works on the context it selected with use_context, so planners with contexts of their own run side by side
+	class Context{
+		public:
+			ExpressionsDictionary::UniqueIdentifier identifiers;
+			WordMap words;
+			ReverseWordMap iwords;
+			ExpressionMap exprs;
+			// One trie per expression type (by its bit), they share the identifiers so keys stay unique in their low bits
+			std::vector<ReverseExpressionMap> iexprs;
+			std::vector<idexpr_t> facts;
+			Groups groups;
+			WorldRegistry worlds;
+			WorldRegistry* registry;
+			Arena<Constant> constants;
+			Arena<Variable> variables;
+			Arena<Atom> atoms;
+			Arena<And> ands;
+			Arena<Or> ors;
+			Arena<Not> nots;
+			Arena<Equals> equals;
+			Arena<Imply> implies;
+			Arena<When> whens;
+			Arena<Exists> exists;
+			Arena<Forall> foralls;
+			ArgumentPool arguments;
+			Context();
+			Context(const Context&) = delete;
+			Context& operator=(const Context&) = delete;
+			void clear();
+	};
+	
+	// Conjunction of literals over facts and the effects it triggers, the form grounded actions are compiled to
+	class ConditionalEffect{
+		public:
+			Facts positive;
+			Facts negative;
+			Facts addList;
+			Facts removeList;
+			inline bool isModeledBy(const World* world) const{
+				for(idfact_t fact : positive){ if(!world->contains(fact)){ return false; } }
+				for(idfact_t fact : negative){ if(world->contains(fact)){ return false; } }
+				return true;
+			}
+			void sort();
+	};
+	
+	// Grounded action lowered to sorted fact arrays, the flags tell whether the precondition and the effect could be compiled
+	class CompiledAction : public ConditionalEffect{
+		public:
+			std::vector<ConditionalEffect> conditional;
+			bool flatPrecondition;
+			bool flatEffect;
+			CompiledAction();
+			CompiledAction(Expression* precondition,Expression* effect);
 	};
 	
 };
@@ -2,37 +2,96 @@
 #define EXPRESSIONS_DICTIONARY_CPP
 #include "ExpressionsDictionary.h"
 namespace ExpressionsDictionary{
-	unsigned long long int UniqueIdentifier::uniqueID = 0;
-	// Node Trie
-	template <typename K,typename D> Trie<K,D>::NodeTrie::NodeTrie() : key(0), data(0){ }
-	template <typename K,typename D> Trie<K,D>::NodeTrie::NodeTrie(K key) : key(key),data(0){ }
-	template <typename K,typename D> Trie<K,D>::NodeTrie::~NodeTrie(){
-		for(auto it = children.begin(); it != children.end(); ++it){
-			delete it->second;
-		}
-	}
+	void UniqueIdentifier::restart(){ uniqueID = 0; }
 	// Trie
-	template <typename K,typename D> Trie<K,D>::Trie() : count(0){ root = new NodeTrie(); }
-	template <typename K,typename D> Trie<K,D>::~Trie(){ delete root; }
+	template <typename K,typename D> Trie<K,D>::Trie(UniqueIdentifier* identifiers) : slots(16), used(0), generation(1), count(0), shared(identifiers){ add(); }
 	template <typename K,typename D> unsigned long long int Trie<K,D>::size(){ return count; }
+	template <typename K,typename D> inline size_t Trie<K,D>::hash(uint32_t parent,Key key){
+		uint64_t h = ((uint64_t)parent<<32) ^ (uint64_t)key;
+		h *= 0x9E3779B97F4A7C15ULL;
+		return h ^ (h>>29);
+	}
+	template <typename K,typename D> uint32_t Trie<K,D>::add(){
+		nodes.emplace_back();
+		nodes.back().data = 0;
+		nodes.back().count = 0;
+		return nodes.size()-1;
+	}
+	template <typename K,typename D> void Trie<K,D>::grow(){
+		std::vector<Slot> old(slots.size()<<1);
+		std::swap(old,slots);
+		used = 0;
+		for(const Slot &slot : old){
+			if(slot.generation == generation){ place(slot.parent,slot.key,slot.child); }
+		}
+	}
+	template <typename K,typename D> void Trie<K,D>::place(uint32_t parent,Key key,uint32_t child){
+		if((used+1)*2 > slots.size()){ grow(); }
+		size_t mask = slots.size()-1;
+		size_t i = hash(parent,key) & mask;
+		while(slots[i].generation == generation){ i = (i+1) & mask; }
+		slots[i].key = key;
+		slots[i].parent = parent;
+		slots[i].child = child;
+		slots[i].generation = generation;
+		used++;
+	}
 	template <typename K,typename D> template<class C> D& Trie<K,D>::operator[](const C &container){
-		NodeTrie* ptr = root;
+		uint32_t node = 0;
 		for(auto elem : container){
-			NodeTrie** tmp = &ptr->children[elem];
-			if(!*tmp){ *tmp = new NodeTrie(elem); }
-			ptr = *tmp;
+			Key key = elem;
+			NodeTrie* ptr = &nodes[node];
+			uint32_t next = 0;
+			if(ptr->count <= INLINE){
+				for(uint32_t i = 0; i < ptr->count; i++){
+					if(ptr->keys[i] == key){
+						next = ptr->children[i];
+						break;
+					}
+				}
+			}else{
+				size_t mask = slots.size()-1;
+				for(size_t i = hash(node,key) & mask; slots[i].generation == generation; i = (i+1) & mask){
+					if(slots[i].parent == node && slots[i].key == key){
+						next = slots[i].child;
+						break;
+					}
+				}
+			}
+			// The root is never a child, so 0 marks a missing one
+			if(!next){
+				next = add();
+				ptr = &nodes[node];
+				if(ptr->count < INLINE){
+					ptr->keys[ptr->count] = key;
+					ptr->children[ptr->count++] = next;
+				}else{
+					if(ptr->count == INLINE){
+						for(uint32_t i = 0; i < INLINE; i++){ place(node,ptr->keys[i],ptr->children[i]); }
+						ptr->count++;
+					}
+					place(node,key,next);
+				}
+			}
+			node = next;
 		}
-		if(!ptr->data){
+		D &d = nodes[node].data;
+		if(!d){
 			++count;
-			ptr->data = ++uniqueID;
+			d = (shared?shared:&own)->next();
 		}
-		return ptr->data;
+		return d;
 	}
 	template <typename K,typename D> void Trie<K,D>::clear(){
-		for(auto it = root->children.begin(); it != root->children.end(); ++it){
-			delete it->second;
+		// Slots of older generations read as empty, they only need resetting when the generation wraps around
+		if(!++generation){
+			for(Slot &slot : slots){ slot.generation = 0; }
+			generation = 1;
 		}
-		root->children.clear();
+		nodes.resize(1);
+		nodes[0].data = 0;
+		nodes[0].count = 0;
+		used = 0;
 		count = 0;
 	}
 }
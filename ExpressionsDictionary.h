@@ -1,29 +1,58 @@
 #ifndef EXPRESSIONS_DICTIONARY_H
 #define EXPRESSIONS_DICTIONARY_H
-#include <map>
-// TODO: Consider AVL-tree for more balanced tree -> faster lookups
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
 namespace ExpressionsDictionary{
+	// Source of the identifiers of new sequences, tries sharing one give identifiers unique among all of them
 	class UniqueIdentifier{
 		protected:
-			static unsigned long long int uniqueID;
+			unsigned long long int uniqueID;
+		public:
+			UniqueIdentifier() : uniqueID(0) {};
+			inline unsigned long long int next(){ return ++uniqueID; }
+			// Identifiers start again from 1, only once every trie sharing them is cleared
+			void restart();
 	};
-	template <typename K,typename D> class Trie : public UniqueIdentifier{
+	// Trie over sequences of K: the nodes are a slab indexed by position (the root is 0), a node keeps its first INLINE children
+	// in place and moves them to an open addressing table keyed by parent and element once it has more. Clearing bumps the
+	// generation that tells the live slots of the table apart, so it takes constant time and keeps the memory for the next
+	// sequences. Identifiers come from the UniqueIdentifier given on construction, or from one of its own
+	template <typename K,typename D> class Trie{
 		protected:
+			using Key = typename std::remove_const<K>::type;
+			static const uint32_t INLINE = 4;
 			class NodeTrie{
 				public:
-					K key;
 					D data;
-					std::map<K,NodeTrie*> children;
-					NodeTrie();
-					NodeTrie(K key);
-					~NodeTrie();
+					// Children kept in place, more than INLINE means they are in the table
+					uint32_t count;
+					Key keys[INLINE];
+					uint32_t children[INLINE];
+			};
+			class Slot{
+				public:
+					Key key;
+					uint32_t parent;
+					uint32_t child;
+					uint32_t generation;
 			};
-			NodeTrie* root;
+			std::vector<NodeTrie> nodes;
+			std::vector<Slot> slots;
+			size_t used;
+			uint32_t generation;
 			unsigned long long int count;
+			UniqueIdentifier own;
+			UniqueIdentifier* shared;
+			static inline size_t hash(uint32_t parent,Key key);
+			void grow();
+			void place(uint32_t parent,Key key,uint32_t child);
+			uint32_t add();
 		public:
-			Trie();
-			~Trie();
+			Trie(UniqueIdentifier* identifiers=0);
 			unsigned long long int size();
+			// The reference is valid until the next sequence is added
 			template <class C> D& operator[](const C &container);
 			void clear();
 	};
@@ -3,27 +3,26 @@
 #include "Planner.h"
 #include "Expressions.h"
 namespace Heuristics{
-	Expressions::Atoms positiveGoal;
 	
-	void setGoal(Expressions::Expression* goalExpression){
-		positiveGoal.clear();
-		Expressions::Atoms ignoreList;
-		goalExpression->applyPositive(positiveGoal,ignoreList);
-	}	
-	
-	double atomDistanceHeuristics(const DoradoPlanner::WorldState& state){
-		Expressions::Atoms::iterator itPos = positiveGoal.begin();
-		unsigned int count = 0;
-		for(Expressions::Atoms::iterator it = state.world->atoms.begin(); itPos != positiveGoal.end() && it != state.world->atoms.end(); ++it){
-			while(*itPos<=*it && itPos != positiveGoal.end()){
-				if(*itPos == *it){
-					count++;
+	// Counts the atoms of the positive goal missing from the world
+	class AtomDistance{
+		public:
+			Expressions::Bits positiveGoal;
+			AtomDistance(Expressions::Expression* goalExpression){
+				Expressions::Atoms addList;
+				Expressions::Atoms ignoreList;
+				goalExpression->applyPositive(addList,ignoreList);
+				Expressions::World::pack(addList,positiveGoal);
+			}
+			double operator()(const DoradoPlanner::WorldState& state) const{
+				unsigned int count = 0;
+				state.world->load();
+				for(size_t i = 0; i < positiveGoal.size(); i++){
+					count += Expressions::popcount(positiveGoal[i] & ~state.world->word(i));
 				}
-				++itPos;
+				return count;
 			}
-		}
-		return positiveGoal.size() - count;
-	}
+	};
 	
 };
 #endif
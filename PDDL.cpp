@@ -3,6 +3,8 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -18,8 +20,8 @@ namespace PDDL{
 	std::vector<std::string> splitSections(const std::string &s);
 	std::string flattenString(std::string s);
 	void removeComments(std::string &s);
-	Domain* parsePDDLDomain(const std::string &filename);
-	Problem* parsePDDLProblem(const std::string &filename);
+	std::shared_ptr<Domain> parsePDDLDomain(const std::string &filename);
+	std::shared_ptr<Problem> parsePDDLProblem(const std::string &filename);
 	void releaseMemory();
 	
 	const char* supported[] = {":strips",":typing",":disjunctive-preconditions",
@@ -27,9 +29,13 @@ namespace PDDL{
 								":universal-preconditions",":quantified-preconditions",
 								":conditional-effects",":adl", 0};
 	
+	// Guards the parsed domains and problems, planners on other threads parse and release them through the same maps
+	// A parsed domain or problem lives while the cache or a caller holds it, so releasing never frees one in use
+	std::mutex cacheMutex;
+	
 	class Domain{
 		protected:
-			static std::map<std::string,Domain*> domains;
+			static std::map<std::string,std::shared_ptr<Domain>> domains;
 		public:
 			class Action{
 				public:
@@ -46,27 +52,27 @@ namespace PDDL{
 			std::map<std::string,std::set<std::string>> constants;
 			std::vector<Action> actions;
 			friend std::ostream& operator<<(std::ostream &out, Domain &d);
-			friend Domain* parsePDDLDomain(const std::string &filename);
-			friend Problem* parsePDDLProblem(const std::string &filename);
+			friend std::shared_ptr<Domain> parsePDDLDomain(const std::string &filename);
+			friend std::shared_ptr<Problem> parsePDDLProblem(const std::string &filename);
 			friend void releaseMemory();
 	};
 	
 	class Problem{
 		protected:
-			static std::map<std::pair<std::string,std::string>,Problem*> problems;
+			static std::map<std::pair<std::string,std::string>,std::shared_ptr<Problem>> problems;
 		public:
-			Domain* domain;
+			std::shared_ptr<Domain> domain;
 			std::string problem;
 			std::string goal;
 			std::set<std::string> init;
 			std::map<std::string,std::set<std::string>> sets;
 			friend std::ostream& operator<<(std::ostream &out, Problem &p);
-			friend Problem* parsePDDLProblem(const std::string &filename);
+			friend std::shared_ptr<Problem> parsePDDLProblem(const std::string &filename);
 			friend void releaseMemory();
 	};
 	
 	// Domain class
-	std::map<std::string,Domain*> Domain::domains;
+	std::map<std::string,std::shared_ptr<Domain>> Domain::domains;
 	
 	std::ostream& operator<<(std::ostream &out, const Domain::Action &a){
 		int i=0;
@@ -108,7 +114,7 @@ namespace PDDL{
 	}
 	
 	// Problem class
-	std::map<std::pair<std::string,std::string>,Problem*> Problem::problems;
+	std::map<std::pair<std::string,std::string>,std::shared_ptr<Problem>> Problem::problems;
 	
 	std::ostream& operator<<(std::ostream &out, Problem &p){
 		out << "(define " << std::endl;
@@ -188,8 +194,9 @@ namespace PDDL{
 	}
 	
 	// TODO: Make safe -> adds exceptions/errors
-	Domain* parsePDDLDomain(const std::string &filename){
-		Domain* domain = 0;
+	std::shared_ptr<Domain> parsePDDLDomain(const std::string &filename){
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::shared_ptr<Domain> domain;
 		std::string domainStr = loadFile(filename);
 		removeComments(domainStr);
 		size_t lPar = domainStr.find_first_of('(');
@@ -201,19 +208,19 @@ namespace PDDL{
 			std::vector<std::string> subsections = splitSections(section);
 			if(subsections.empty()){ continue; }
 			if(subsections[0]=="domain"){
-				Domain** domainPtr = &Domain::domains[subsections[1]];
-				if(!*domainPtr){
-					*domainPtr = new Domain();
-					domain = *domainPtr;
+				std::shared_ptr<Domain> &domainPtr = Domain::domains[subsections[1]];
+				if(!domainPtr){
+					domainPtr = std::make_shared<Domain>();
+					domain = domainPtr;
 				}else{
-					domain = *domainPtr;
+					domain = domainPtr;
 					break;
 				}
 				domain->domain = subsections[1];
 			}
 			if(!domain){ continue; }
 			if(subsections[0]==":extends"){
-				Domain* domainPtr = Domain::domains.at(subsections[1]);
+				std::shared_ptr<Domain> domainPtr = Domain::domains.at(subsections[1]);
 				if(domainPtr){
 					domain->requirements = domainPtr->requirements;
 					domain->types = domainPtr->types;
@@ -306,8 +313,9 @@ namespace PDDL{
 		return domain;
 	}
 	
-	Problem* parsePDDLProblem(const std::string &filename){
-		Problem* problem = 0;
+	std::shared_ptr<Problem> parsePDDLProblem(const std::string &filename){
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::shared_ptr<Problem> problem;
 		std::string problemStr = loadFile(filename);
 		removeComments(problemStr);
 		size_t lPar = problemStr.find_first_of('(');
@@ -324,13 +332,13 @@ namespace PDDL{
 					tmpStr = subsections[1];
 				}else{
 					std::pair<std::string,std::string> key = (subsections[0].at(0)==':')?std::pair<std::string,std::string>{subsections[1],tmpStr}:std::pair<std::string,std::string>{tmpStr,subsections[1]};
-					Problem** problemPtr = &Problem::problems[key];
-					if(!*problemPtr){
-						*problemPtr = new Problem();
-						(*problemPtr)->domain = Domain::domains.at((subsections[0].at(0)==':')?subsections[1]:tmpStr);
-						problem = *problemPtr;
+					std::shared_ptr<Problem> &problemPtr = Problem::problems[key];
+					if(!problemPtr){
+						problemPtr = std::make_shared<Problem>();
+						problemPtr->domain = Domain::domains.at((subsections[0].at(0)==':')?subsections[1]:tmpStr);
+						problem = problemPtr;
 					}else{
-						problem = *problemPtr;
+						problem = problemPtr;
 						break;
 					}
 				}
@@ -377,15 +385,24 @@ namespace PDDL{
 		return problem;
 	}
 	
+	// Drops the cached problems and domains nobody else holds, those still in use stay cached until a later release
+	// Problems go first, they hold their domain
 	void releaseMemory(){
-		for(const std::pair<std::string,Domain*> &dom : Domain::domains){
-			delete dom.second;
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		for(auto prob = Problem::problems.begin(); prob != Problem::problems.end();){
+			if(prob->second.use_count() == 1){
+				prob = Problem::problems.erase(prob);
+			}else{
+				++prob;
+			}
 		}
-		for(const std::pair<std::pair<std::string,std::string>,Problem*> &prob : Problem::problems){
-			delete prob.second;
+		for(auto dom = Domain::domains.begin(); dom != Domain::domains.end();){
+			if(dom->second.use_count() == 1){
+				dom = Domain::domains.erase(dom);
+			}else{
+				++dom;
+			}
 		}
-		Domain::domains.clear();
-		Problem::problems.clear();
 	}
 };
 
@@ -3,76 +3,508 @@
 #include "Planner.h"
 #include "Heuristics.cpp"
 
-// Static variables
-std::map<AStar::idaction_t,std::string> DoradoPlanner::Action::mapActions;
-std::vector<DoradoPlanner::Action> DoradoPlanner::WorldState::actions;
-Expressions::Expression* DoradoPlanner::WorldState::goal = 0;
-
 // Action subclass
-DoradoPlanner::Action::Action(const std::string &n,Expressions::Expression* pc,Expressions::Expression* ef) : name(n), precondition(pc), effect(ef) {
-	actionid = mapActions.size()+1;
-	mapActions[actionid] = n;
+DoradoPlanner::Action::Action(const std::string &n,Expressions::Expression* pc,Expressions::Expression* ef,AStar::idaction_t id) : name(n), precondition(pc), effect(ef), actionid(id) {};
+
+// Grounder subclass
+void DoradoPlanner::Grounder::ground(const PDDL::Domain* domain,const PDDL::Problem* problem,const Expressions::World* initial,std::vector<Action> &actions){
+	std::vector<Schema> schemas;
+	index.clear();
+	known.clear();
+	pending.clear();
+	names.clear();
+	fluents.clear();
+	statics.clear();
+	atoms = initial->getAtoms();
+	for(const PDDL::Domain::Action &act : domain->actions){
+		Schema schema;
+		schema.action = &act;
+		schema.precondition = Expressions::make_expression(act.precondition);
+		schema.effect = Expressions::make_expression(act.effect);
+		for(const std::pair<std::string,std::string> &param : act.parameters){
+			schema.parameters.push_back(Expressions::get_idword(param.first));
+			schema.objects.emplace_back();
+			for(const std::string &obj : problem->sets.at(param.second)){
+				Expressions::idexpr_t id = Expressions::get_idword(obj);
+				names[id] = obj;
+				schema.objects.back().insert(id);
+			}
+		}
+		// Predicates the effects add or delete are fluent, the others keep their initial atoms in every world
+		Expressions::Atoms addList;
+		Expressions::Atoms removeList;
+		schema.effect->ground()->applyPositive(addList,removeList);
+		for(const Expressions::Atoms &list : {addList,removeList}){
+			for(Expressions::idexpr_t key : list){ fluents.insert(static_cast<Expressions::Atom*>(Expressions::get_expression(key))->args.front()); }
+		}
+		schemas.push_back(schema);
+	}
+	for(Expressions::idexpr_t key : atoms){
+		const Expressions::ArgumentSpan &args = static_cast<Expressions::Atom*>(Expressions::get_expression(key))->args;
+		if(!fluents.count(args.front())){ statics.insert(Expressions::Arguments(args.begin(),args.end())); }
+	}
+	for(Schema &schema : schemas){
+		// Quantifiers are expanded to read the literals they require, the parameters are still free
+		Expressions::Atoms positive;
+		Expressions::Atoms negative;
+		schema.precondition->ground()->requiredAtoms(positive,negative);
+		std::vector<bool> bound(schema.parameters.size(),false);
+		// Static atoms go first, the pivots skip them after the first round
+		for(bool fluent : {false,true}){
+			for(Expressions::idexpr_t key : positive){
+				const Expressions::ArgumentSpan &args = static_cast<Expressions::Atom*>(Expressions::get_expression(key))->args;
+				if(fluents.count(args.front()) != fluent){ continue; }
+				schema.required.push_back(Expressions::Arguments(args.begin(),args.end()));
+				schema.slots.push_back(slots(schema,args));
+				for(int slot : schema.slots.back()){
+					if(slot >= 0){ bound[slot] = true; }
+				}
+				if(!fluent){ schema.fixed++; }
+			}
+		}
+		// Negated static atoms are the only negative literals known before the search
+		for(Expressions::idexpr_t key : negative){
+			const Expressions::ArgumentSpan &args = static_cast<Expressions::Atom*>(Expressions::get_expression(key))->args;
+			if(fluents.count(args.front())){ continue; }
+			schema.forbidden.push_back(Expressions::Arguments(args.begin(),args.end()));
+			schema.forbiddenSlots.push_back(slots(schema,args));
+		}
+		for(unsigned int p = 0; p < bound.size(); p++){
+			if(!bound[p]){ schema.free.push_back(p); }
+		}
+	}
+	for(Expressions::idexpr_t atom : atoms){
+		known.insert(atom);
+		pending.push_back(atom);
+	}
+	rounds = 0;
+	do{
+		rounds++;
+		for(Expressions::idexpr_t key : pending){ reach(static_cast<Expressions::Atom*>(Expressions::get_expression(key)),rounds-1); }
+		pending.clear();
+		for(const Schema &schema : schemas){
+			binding.assign(schema.parameters.size(),0);
+			joined.assign(schema.required.size(),false);
+			if(schema.required.empty()){
+				if(rounds == 1){ instantiate(schema,0,actions); }
+				continue;
+			}
+			// Static atoms were all reached by the initial world, they are only the newest atoms in the first round
+			for(size_t pivot = rounds == 1?0:schema.fixed; pivot < schema.required.size(); pivot++){ match(schema,0,pivot,rounds,actions); }
+		}
+	}while(!pending.empty());
+}
+// Parameter every argument of the atom takes, -1 for the predicate and the constants
+std::vector<int> DoradoPlanner::Grounder::slots(const Schema &schema,const Expressions::ArgumentSpan &args) const{
+	std::vector<int> result(args.size(),-1);
+	for(size_t i = 1; i < args.size(); i++){
+		for(size_t p = 0; p < schema.parameters.size(); p++){
+			if(args[i] == schema.parameters[p]){ result[i] = p; }
+		}
+	}
+	return result;
+}
+// False when the binding makes a negated static atom hold, atoms with parameters still unbound are checked later
+bool DoradoPlanner::Grounder::allowed(const Schema &schema) const{
+	Expressions::Arguments args;
+	for(size_t f = 0; f < schema.forbidden.size(); f++){
+		const std::vector<int> &slots = schema.forbiddenSlots[f];
+		args = schema.forbidden[f];
+		bool complete = true;
+		for(size_t i = 1; i < args.size() && complete; i++){
+			if(slots[i] >= 0){
+				args[i] = binding[slots[i]];
+				complete = args[i] != 0;
+			}
+		}
+		if(complete && statics.count(args)){ return false; }
+	}
+	return true;
+}
+// Adds the atom to the index of its predicate and to those of every argument
+void DoradoPlanner::Grounder::reach(const Expressions::Atom* atom,unsigned int round){
+	const Expressions::ArgumentSpan &args = atom->args;
+	index[{args.front(),0,0}].push_back({atom,round});
+	for(size_t i = 1; i < args.size(); i++){ index[{args.front(),args[i],i}].push_back({atom,round}); }
+}
+// Narrowest index for the required atom under the binding, restricted to the atoms older than the previous round before the
+// pivot and to those of the previous round at the pivot; false when the atom has no candidate
+bool DoradoPlanner::Grounder::candidates(const Schema &schema,size_t atom,size_t pivot,unsigned int round,const Entries* &entries,size_t &first,size_t &last) const{
+	const Expressions::Arguments &pattern = schema.required[atom];
+	const std::vector<int> &slots = schema.slots[atom];
+	entries = 0;
+	for(size_t i = 0; i < pattern.size(); i++){
+		Expressions::idexpr_t value = i?(slots[i] < 0?pattern[i]:binding[slots[i]]):0;
+		if(i && !value){ continue; }
+		std::unordered_map<Key,Entries,KeyHash>::const_iterator found = index.find({pattern.front(),value,i});
+		if(found == index.end()){ return false; }
+		// Entries are in the order of their rounds
+		const Entries &list = found->second;
+		size_t previous = std::lower_bound(list.begin(),list.end(),round-1,[](const std::pair<const Expressions::Atom*,unsigned int> &entry,unsigned int r){ return entry.second < r; }) - list.begin();
+		size_t from = atom == pivot?previous:0;
+		size_t to = atom < pivot?previous:list.size();
+		if(!entries || to-from < last-first){
+			entries = &list;
+			first = from;
+			last = to;
+		}
+	}
+	return first < last;
+}
+// Joins the remaining required atoms, the one with the fewest candidates first
+void DoradoPlanner::Grounder::match(const Schema &schema,size_t depth,size_t pivot,unsigned int round,std::vector<Action> &actions){
+	if(depth == schema.required.size()){
+		instantiate(schema,0,actions);
+		return;
+	}
+	size_t atom = schema.required.size();
+	const Entries* entries = 0;
+	size_t first = 0, last = 0;
+	for(size_t a = 0; a < schema.required.size(); a++){
+		if(joined[a]){ continue; }
+		const Entries* list;
+		size_t from, to;
+		if(!candidates(schema,a,pivot,round,list,from,to)){ return; }
+		if(!entries || to-from < last-first){
+			atom = a;
+			entries = list;
+			first = from;
+			last = to;
+		}
+	}
+	const Expressions::Arguments &pattern = schema.required[atom];
+	const std::vector<int> &slots = schema.slots[atom];
+	std::vector<int> bound;
+	joined[atom] = true;
+	for(size_t e = first; e < last; e++){
+		const Expressions::ArgumentSpan &args = (*entries)[e].first->args;
+		if(args.size() != pattern.size()){ continue; }
+		bool matches = true;
+		bound.clear();
+		for(size_t i = 1; i < args.size() && matches; i++){
+			if(slots[i] < 0){
+				matches = args[i] == pattern[i];
+			}else if(binding[slots[i]]){
+				matches = args[i] == binding[slots[i]];
+			}else if(schema.objects[slots[i]].count(args[i])){
+				binding[slots[i]] = args[i];
+				bound.push_back(slots[i]);
+			}else{
+				matches = false;
+			}
+		}
+		if(matches && (bound.empty() || allowed(schema))){ match(schema,depth+1,pivot,round,actions); }
+		for(int slot : bound){ binding[slot] = 0; }
+	}
+	joined[atom] = false;
+}
+// Takes every object for the free parameters from the given one on, then substitutes the binding in the action
+void DoradoPlanner::Grounder::instantiate(const Schema &schema,size_t parameter,std::vector<Action> &actions){
+	if(parameter < schema.free.size()){
+		unsigned int p = schema.free[parameter];
+		for(Expressions::idexpr_t obj : schema.objects[p]){
+			binding[p] = obj;
+			if(allowed(schema)){ instantiate(schema,parameter+1,actions); }
+		}
+		binding[p] = 0;
+		return;
+	}
+	std::string name = schema.action->name;
+	Expressions::Expression* precondition = schema.precondition;
+	Expressions::Expression* effect = schema.effect;
+	for(size_t p = 0; p < schema.parameters.size(); p++){
+		name += " " + names[binding[p]];
+		precondition = precondition->substitute(schema.parameters[p],binding[p]);
+		effect = effect->substitute(schema.parameters[p],binding[p]);
+	}
+	// Quantifiers are expanded once here, evaluating the actions during the search never registers expressions; the static
+	// atoms are decided here too, so the worlds don't need them
+	precondition = precondition->ground()->simplify(fluents,atoms);
+	effect = effect->ground()->simplify(fluents,atoms);
+	Expressions::Atoms addList;
+	Expressions::Atoms removeList;
+	effect->applyPositive(addList,removeList);
+	for(Expressions::idexpr_t atom : addList){
+		if(known.insert(atom).second){ pending.push_back(atom); }
+	}
+	actions.push_back({name,precondition,effect,actions.size()+1});
+}
+
+// Successor generator subclass
+void DoradoPlanner::SuccessorGenerator::build(const std::vector<Action> &actions){
+	std::vector<std::vector<std::pair<Expressions::idfact_t,bool>>> conditions(actions.size());
+	std::vector<std::pair<unsigned int,unsigned int>> entries;
+	nodes.clear();
+	leaves.clear();
+	for(unsigned int i = 0; i < actions.size(); i++){
+		const Expressions::CompiledAction &compiled = actions[i].compiled;
+		if(compiled.flatPrecondition){
+			// Unsatisfiable preconditions require NOFACT, sorted last
+			if(!compiled.positive.empty() && compiled.positive.back() == Expressions::NOFACT){ continue; }
+			for(Expressions::idfact_t fact : compiled.positive){ conditions[i].push_back({fact,true}); }
+			for(Expressions::idfact_t fact : compiled.negative){ conditions[i].push_back({fact,false}); }
+			std::sort(conditions[i].begin(),conditions[i].end());
+		}
+		entries.push_back({i,0});
+	}
+	build(entries,conditions);
+}
+// Entries are actions with the position of their next untested condition, nodes test the lowest fact still untested
+unsigned int DoradoPlanner::SuccessorGenerator::build(std::vector<std::pair<unsigned int,unsigned int>> &entries,const std::vector<std::vector<std::pair<Expressions::idfact_t,bool>>> &conditions){
+	unsigned int id = nodes.size();
+	nodes.emplace_back();
+	Expressions::idfact_t fact = Expressions::NOFACT;
+	for(const std::pair<unsigned int,unsigned int> &entry : entries){
+		if(entry.second < conditions[entry.first].size()){ fact = std::min(fact,conditions[entry.first][entry.second].first); }
+	}
+	std::vector<std::pair<unsigned int,unsigned int>> present, absent, any;
+	nodes[id].first = leaves.size();
+	for(const std::pair<unsigned int,unsigned int> &entry : entries){
+		if(entry.second == conditions[entry.first].size()){
+			leaves.push_back(entry.first);
+		}else if(conditions[entry.first][entry.second].first == fact){
+			(conditions[entry.first][entry.second].second?present:absent).push_back({entry.first,entry.second+1});
+		}else{
+			any.push_back(entry);
+		}
+	}
+	nodes[id].last = leaves.size();
+	nodes[id].fact = fact;
+	entries.clear();
+	// The root is never a child, so 0 marks a missing child
+	if(!present.empty()){
+		unsigned int child = build(present,conditions);
+		nodes[id].present = child;
+	}
+	if(!absent.empty()){
+		unsigned int child = build(absent,conditions);
+		nodes[id].absent = child;
+	}
+	if(!any.empty()){
+		unsigned int child = build(any,conditions);
+		nodes[id].any = child;
+	}
+	return id;
+}
+// Yields the indexes of the candidate actions in increasing order, so neighbors keep the order of the actions, returns
+// the number of visited nodes
+unsigned int DoradoPlanner::SuccessorGenerator::applicable(const Expressions::World* world,std::vector<unsigned int> &result) const{
+	unsigned int visited = 0;
+	result.clear();
+	if(nodes.empty()){ return visited; }
+	std::vector<unsigned int> pending{0};
+	while(!pending.empty()){
+		unsigned int id = pending.back();
+		pending.pop_back();
+		// Follow the chain of don't care children, branching on the tested facts
+		while(true){
+			const Node &node = nodes[id];
+			visited++;
+			result.insert(result.end(),leaves.begin()+node.first,leaves.begin()+node.last);
+			unsigned int branch = world->contains(node.fact)?node.present:node.absent;
+			if(branch){ pending.push_back(branch); }
+			if(!node.any){ break; }
+			id = node.any;
+		}
+	}
+	std::sort(result.begin(),result.end());
+	return visited;
+}
+
+// Applicability masks subclass
+void DoradoPlanner::ApplicabilityMasks::build(const std::vector<Action> &actions){
+	std::vector<std::map<int32_t,std::pair<uint64_t,uint64_t>>> slots;
+	blocks.clear();
+	lanes.clear();
+	words.clear();
+	positive.clear();
+	negative.clear();
+	width = 1;
+	usable = true;
+	vectorized = supportsAVX2();
+	for(const Action &act : actions){
+		if(!act.compiled.flatPrecondition){
+			usable = false;
+			return;
+		}
+	}
+	for(unsigned int i = 0; i < actions.size(); i++){
+		const Expressions::CompiledAction &compiled = actions[i].compiled;
+		if(!compiled.positive.empty() && compiled.positive.back() == Expressions::NOFACT){ continue; }
+		std::map<int32_t,std::pair<uint64_t,uint64_t>> masks;
+		for(Expressions::idfact_t fact : compiled.positive){ masks[fact>>6].first |= 1ULL<<(fact&63); }
+		for(Expressions::idfact_t fact : compiled.negative){ masks[fact>>6].second |= 1ULL<<(fact&63); }
+		if(!masks.empty()){ width = std::max<size_t>(width,masks.rbegin()->first+1); }
+		lanes.push_back(i);
+		slots.push_back(masks);
+	}
+	// Every block has as many slots as its longest precondition, shorter ones are padded with empty masks and missing
+	// lanes with masks that can't hold
+	for(unsigned int first = 0; first < lanes.size(); first += LANES){
+		size_t count = 1;
+		for(unsigned int lane = first; lane < first+LANES && lane < lanes.size(); lane++){ count = std::max(count,slots[lane].size()); }
+		blocks.push_back(words.size()/LANES);
+		std::vector<std::map<int32_t,std::pair<uint64_t,uint64_t>>::const_iterator> next;
+		for(unsigned int lane = first; lane < first+LANES && lane < lanes.size(); lane++){ next.push_back(slots[lane].begin()); }
+		for(size_t slot = 0; slot < count; slot++){
+			for(unsigned int lane = 0; lane < LANES; lane++){
+				if(first+lane >= lanes.size()){
+					words.push_back(0);
+					positive.push_back(1);
+					negative.push_back(1);
+				}else if(next[lane] == slots[first+lane].end()){
+					words.push_back(0);
+					positive.push_back(0);
+					negative.push_back(0);
+				}else{
+					words.push_back(next[lane]->first);
+					positive.push_back(next[lane]->second.first);
+					negative.push_back(next[lane]->second.second);
+					++next[lane];
+				}
+			}
+		}
+	}
+	blocks.push_back(words.size()/LANES);
+}
+bool DoradoPlanner::ApplicabilityMasks::supportsAVX2(){
+#if defined(PLANNER_AVX2)
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+// Yields the indexes of the applicable actions in increasing order
+void DoradoPlanner::ApplicabilityMasks::applicable(const Expressions::World* world,std::vector<unsigned int> &result) const{
+	const size_t LOCAL = 64;
+	uint64_t local[LOCAL];
+	std::vector<uint64_t> extended;
+	uint64_t* buffer = local;
+	if(width > LOCAL){
+		extended.resize(width);
+		buffer = extended.data();
+	}
+	// Worlds drop their trailing zero words, the kernels read the full width
+	size_t size = std::min<size_t>(width,world->length);
+	std::copy(world->words,world->words+size,buffer);
+	std::fill(buffer+size,buffer+width,0);
+	result.clear();
+#if defined(PLANNER_AVX2)
+	if(vectorized){
+		avx2Kernel(buffer,result);
+		return;
+	}
+#endif
+	scalarKernel(buffer,result);
+}
+void DoradoPlanner::ApplicabilityMasks::scalarKernel(const uint64_t* buffer,std::vector<unsigned int> &result) const{
+	for(size_t block = 0; block+1 < blocks.size(); block++){
+		unsigned int pass = 0;
+		uint64_t fail[LANES] = {0};
+		for(size_t entry = blocks[block]*LANES; entry < blocks[block+1]*LANES; entry += LANES){
+			for(unsigned int lane = 0; lane < LANES; lane++){
+				uint64_t w = buffer[words[entry+lane]];
+				fail[lane] |= (positive[entry+lane] & ~w) | (negative[entry+lane] & w);
+			}
+		}
+		for(unsigned int lane = 0; lane < LANES; lane++){ pass |= (!fail[lane])<<lane; }
+		for(unsigned int lane = 0; lane < LANES; lane++){
+			if((pass>>lane)&1){ result.push_back(lanes[block*LANES+lane]); }
+		}
+	}
+}
+#if defined(PLANNER_AVX2)
+__attribute__((target("avx2"))) void DoradoPlanner::ApplicabilityMasks::avx2Kernel(const uint64_t* buffer,std::vector<unsigned int> &result) const{
+	for(size_t block = 0; block+1 < blocks.size(); block++){
+		__m256i fail = _mm256_setzero_si256();
+		for(size_t entry = blocks[block]*LANES; entry < blocks[block+1]*LANES; entry += LANES){
+			__m256i w = _mm256_i32gather_epi64((const long long*)buffer,_mm_loadu_si128((const __m128i*)&words[entry]),8);
+			__m256i p = _mm256_loadu_si256((const __m256i*)&positive[entry]);
+			__m256i n = _mm256_loadu_si256((const __m256i*)&negative[entry]);
+			fail = _mm256_or_si256(fail,_mm256_or_si256(_mm256_andnot_si256(w,p),_mm256_and_si256(w,n)));
+		}
+		unsigned int pass = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(fail,_mm256_setzero_si256())));
+		for(unsigned int lane = 0; lane < LANES; lane++){
+			if((pass>>lane)&1){ result.push_back(lanes[block*LANES+lane]); }
+		}
+	}
 }
+#endif
 
 // World subclass
-DoradoPlanner::WorldState::WorldState() : world(0) {};
-DoradoPlanner::WorldState::WorldState(Expressions::World* w) : world(w) {};
+DoradoPlanner::WorldState::WorldState() : planner(0), world(0) {};
+DoradoPlanner::WorldState::WorldState(DoradoPlanner* p,Expressions::World* w) : planner(p), world(w) {};
 DoradoPlanner::WorldState::~WorldState() {};
 AStar::idstate_t DoradoPlanner::WorldState::getKey(){ return world->key; }
 AStar::NodeNeighbors<DoradoPlanner::WorldState> DoradoPlanner::WorldState::getNeighbors(){
 	AStar::NodeNeighbors<DoradoPlanner::WorldState> neighbors;
-	for(const Action &act : actions){
-		if(act.precondition->isModeledBy(world)){
-			Expressions::World* w = world->apply(act.effect);
-			neighbors.push_back({WorldState(w),1.0,act.actionid});
+	std::vector<unsigned int> candidates;
+	Expressions::use_context(&planner->context);
+	// The successors are derived from this world, its words must outlive their registration
+	planner->registry->pin(world);
+	if(planner->scoped){ planner->registry->mark(); }
+	world->load();
+	if(planner->masks.usable){
+		planner->masks.applicable(world,candidates);
+	}else{
+		planner->generator.applicable(world,candidates);
+	}
+	for(unsigned int candidate : candidates){
+		const Action &act = planner->actions[candidate];
+		if(act.compiled.flatPrecondition || act.precondition->isModeledBy(world)){
+			Expressions::World* w = act.compiled.flatEffect?world->apply(act.compiled):world->apply(act.effect);
+			neighbors.push_back({WorldState(planner,w),1.0,act.actionid});
 		}
 	}
 	return neighbors;
 }
+void DoradoPlanner::WorldState::releaseNeighbors(){
+	if(planner->scoped){ planner->registry->release(); }
+}
 bool DoradoPlanner::WorldState::goalFunction(const WorldState& state){
-	return goal->isModeledBy(state.world);
+	DoradoPlanner* planner = state.planner;
+	Expressions::use_context(&planner->context);
+	state.world->load();
+	return planner->compiledGoal.flatPrecondition?planner->compiledGoal.isModeledBy(state.world):planner->goal->isModeledBy(state.world);
 }
 
 // DoradoPlanner class
-DoradoPlanner::DoradoPlanner(const std::string filename){
+DoradoPlanner::DoradoPlanner(const std::string filename) : goal(0), registry(0), scoped(false), snapshotInterval(0), finiteDomain(false), groundingTime(0.0), groundedActions(0) {
 	domain = PDDL::parsePDDLDomain(filename);
 }
 
-std::vector<std::string> DoradoPlanner::plan(const std::string filename,AStar::AStarMetrics *mets){
+std::vector<std::string> DoradoPlanner::plan(const std::string filename,AStar::AStarMetrics *mets,const AStar::AStarParameters *params){
 	std::vector<std::string> solution;
-	PDDL::Problem* problem = PDDL::parsePDDLProblem(filename);
-	Action::mapActions.clear();
-	WorldState::actions.clear();
-	std::vector<Action> actions;
-	for(const PDDL::Domain::Action &act : domain->actions){
-		Expressions::Expression* precondition = Expressions::make_expression(act.precondition);
-		Expressions::Expression* effect = Expressions::make_expression(act.effect);
-		if(!act.parameters.size()){
-			actions.push_back({act.name,precondition,effect});
-			continue;
-		}
-		std::vector<std::vector<std::pair<std::string,std::string>>> params = possibleParameters(problem, act.parameters);
-		for(const std::vector<std::pair<std::string,std::string>> &paramPerm : params){
-			std::string name;
-			Expressions::Expression* preconditionGrounded = precondition;
-			Expressions::Expression* effectGrounded = effect;
-			for(const std::pair<std::string,std::string> &paramSubstitution : paramPerm){
-				name =  " " +paramSubstitution.second + name;
-				Expressions::idexpr_t var = Expressions::get_idword(paramSubstitution.first);
-				Expressions::idexpr_t grounded = Expressions::get_idword(paramSubstitution.second);
-				preconditionGrounded = preconditionGrounded->substitute(var,grounded);
-				effectGrounded = effectGrounded->substitute(var,grounded);
-			}
-			name = act.name + name;
-			actions.push_back({name,preconditionGrounded,effectGrounded});
-		}
+	std::shared_ptr<PDDL::Problem> problem = PDDL::parsePDDLProblem(filename);
+	// Everything registered while planning goes to the context of this planner, the calling thread gets its own back after
+	Expressions::Context* previousContext = Expressions::use_context(&context);
+	// Worlds of this problem live in the session registry, freed when plan returns; domain expressions stay cached
+	Expressions::FiniteDomain encoding;
+	Expressions::WorldRegistry session(snapshotInterval);
+	Expressions::WorldRegistry* previousRegistry = Expressions::use_registry(&session);
+	registry = &session;
+	Expressions::reset_facts();
+	mapActions.clear();
+	actions.clear();
+	// The initial world sets the groups the quantifiers are expanded over
+	WorldState initialState(this,Expressions::make_world(problem->init,problem->sets));
+	// Only the actions the initial world can reach are grounded
+	std::chrono::steady_clock::time_point groundingStart = std::chrono::steady_clock::now();
+	std::vector<Action> reached;
+	Grounder grounder;
+	grounder.ground(domain.get(),problem.get(),initialState.world,reached);
+	for(const Action &act : reached){ mapActions[act.actionid] = act.name; }
+	Expressions::Atoms initialAtoms = initialState.world->getAtoms();
+	goal = Expressions::make_expression(problem->goal)->ground()->simplify(grounder.fluents,initialAtoms);
+	// Static atoms hold in every world or in none, the worlds only keep the fluent ones
+	Expressions::Atoms fluentAtoms;
+	for(Expressions::idexpr_t atom : initialAtoms){
+		if(grounder.fluents.count(static_cast<Expressions::Atom*>(Expressions::get_expression(atom))->args.front())){ fluentAtoms.insert(atom); }
 	}
-	WorldState initialState(Expressions::make_world(problem->init,problem->sets));
-	WorldState::goal = Expressions::make_expression(problem->goal);
 	// Remove impossible actions
-	Expressions::Atoms maximumList = initialState.world->atoms;
-	Expressions::Atoms minimumList = initialState.world->atoms;
-	for(const Action &act : actions){
+	Expressions::Atoms maximumList = fluentAtoms;
+	Expressions::Atoms minimumList = maximumList;
+	for(const Action &act : reached){
 		Expressions::Atoms addList;
 		Expressions::Atoms removeList;
 		act.effect->applyPositive(addList,removeList);
@@ -83,43 +515,61 @@ std::vector<std::string> DoradoPlanner::plan(const std::string filename,AStar::A
 			minimumList.erase(expr);
 		}
 	}
-	Expressions::World* maximumWorld = new Expressions::World(0,maximumList);
-	Expressions::World* minimumWorld = new Expressions::World(0,minimumList);
-	for(const Action &act : actions){
-		if(act.precondition->isLaxModeledBy(maximumWorld,minimumWorld)){ WorldState::actions.push_back(act); }
+	// Reachable atoms get the lowest fact indexes, the initial world is packed again without the static atoms
+	Expressions::reset_facts();
+	Expressions::index_facts(maximumList);
+	initialState.world = Expressions::make_world(fluentAtoms);
+	Expressions::World* maximumWorld = Expressions::make_world(maximumList);
+	Expressions::World* minimumWorld = Expressions::make_world(minimumList);
+	for(const Action &act : reached){
+		if(act.precondition->isLaxModeledBy(maximumWorld,minimumWorld)){ actions.push_back(act); }
+	}
+	groundingTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - groundingStart).count();
+	groundedActions = actions.size();
+	// Lower the remaining actions and the goal to fact arrays, expressions are only evaluated when they can't be lowered
+	for(Action &act : actions){ act.compiled = Expressions::CompiledAction(act.precondition,act.effect); }
+	compiledGoal = Expressions::CompiledAction(goal,0);
+	generator.build(actions);
+	masks.build(actions);
+	// The masks test every action while the tree only follows the branches of the world, keep the cheaper on the initial world
+	std::vector<unsigned int> candidates;
+	if(masks.usable && masks.slots() > generator.applicable(initialState.world,candidates)){ masks.usable = false; }
+	if(finiteDomain){
+		std::vector<std::pair<const Expressions::CompiledAction*,Expressions::Expression*>> grounded;
+		for(const Action &act : actions){ grounded.push_back({&act.compiled,act.effect}); }
+		encoding = Expressions::FiniteDomain(Expressions::mutex_groups(initialState.world,grounded));
+		session.encode(&encoding);
 	}
-	delete maximumWorld;
-	delete minimumWorld;
 	// TODO: Smart choose heuristic
-	Heuristics::setGoal(WorldState::goal);
 	//double (*heuristic)(const WorldState& state) = &AStar::defaultHeuristic;
-	double (*heuristic)(const WorldState& state) = &Heuristics::atomDistanceHeuristics;
+	Heuristics::AtomDistance heuristic(goal);
 	// Perform planning
-	AStar::Path<WorldState> path = AStar::AStar(initialState,WorldState::goalFunction,heuristic,mets);
+	AStar::AStarParameters parameters = params?*params:AStar::AStarParameters();
+	// The workers register the successors in the session registry side by side, but evaluating an expression that couldn't be
+	// compiled may register new expressions in the context of the planner
+	bool compiled = compiledGoal.flatPrecondition;
+	for(const Action &act : actions){ compiled = compiled && act.compiled.flatPrecondition && act.compiled.flatEffect; }
+	parameters.exclusiveExpansion = !compiled;
+	// Loading a delta or packed world reuses the buffers of the registry
+	if(snapshotInterval || finiteDomain){ parameters.threads = 1; }
+	// IDA* keeps only the worlds of its current path and their successors
+	scoped = parameters.strategy == AStar::SearchStrategy::IDASTAR;
+	AStar::Path<WorldState> path = AStar::Search(initialState,WorldState::goalFunction,heuristic,mets,&parameters);
 	for(const std::pair<AStar::idaction_t,WorldState> &act : path){
 		if(!act.first){ continue; }
-		solution.push_back(Action::mapActions.at(act.first));
+		solution.push_back(mapActions.at(act.first));
 	}
+	partialPlan.clear();
+	if(mets){
+		for(AStar::idaction_t act : mets->partialActions){ partialPlan.push_back(mapActions.at(act)); }
+	}
+	Expressions::use_registry(previousRegistry);
+	Expressions::use_context(previousContext);
 	return solution;
 }
 
-std::vector<std::vector<std::pair<std::string,std::string>>> DoradoPlanner::possibleParameters(PDDL::Problem* problem, const std::vector<std::pair<std::string,std::string>> &params, int curr){
-	std::vector<std::vector<std::pair<std::string,std::string>>> permutations;
-	int index = curr;
-	if(index+1<params.size()){
-		std::vector<std::vector<std::pair<std::string,std::string>>> nextPermutations = possibleParameters(problem,params,curr+1);
-		for(const std::string &obj : problem->sets.at(params.at(index).second)){
-			for(std::vector<std::pair<std::string,std::string>> perm : nextPermutations){
-				perm.push_back({params.at(index).first,obj});
-				permutations.push_back(perm);
-			}
-		}
-	}else{
-		for(const std::string &obj : problem->sets.at(params.at(index).second)){
-			permutations.push_back({{params.at(index).first,obj}});
-		}
-	}
-	return permutations;
+const std::string& DoradoPlanner::actionName(AStar::idaction_t action) const {
+	return mapActions.at(action);
 }
 
 #endif
@@ -3,41 +3,193 @@
 #include "Astar.cpp"
 #include "Expressions.cpp"
 #include "PDDL.cpp"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
+// The AVX2 kernel of the applicability masks is built for x86 with GCC or Clang whatever the compiler flags, and only taken
+// when the processor running the planner supports it
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PLANNER_AVX2
+#include <immintrin.h>
+#endif
 
 class DoradoPlanner{
 	public:
 		class Action{
 			public:
-				static std::map<AStar::idaction_t,std::string> mapActions;
 				std::string name;
 				Expressions::Expression* precondition;
 				Expressions::Expression* effect;
+				Expressions::CompiledAction compiled;
 				AStar::idaction_t actionid;
-				Action(const std::string &n,Expressions::Expression* pc,Expressions::Expression* ef);
+				Action(const std::string &n,Expressions::Expression* pc,Expressions::Expression* ef,AStar::idaction_t id);
+		};
+		// Grounds the actions by a relaxed reachability fixpoint: the bindings of an action that match reachable atoms with the
+		// atoms its precondition requires are instantiated, and their adds are reachable from the next round on, until a round
+		// reaches no new atom. Every round binds some required atom to an atom the previous round reached, so no binding is
+		// found twice; parameters outside the required atoms take every object of their type. Predicates no effect mentions
+		// are static: negated ones prune the bindings as soon as they are bound, and the grounded actions have them decided by
+		// the initial world. The required atoms are joined as a conjunctive query over hash indexes of the reachable atoms by
+		// predicate, argument position and value, always taking next the atom with the fewest candidates for the binding
+		class Grounder{
+			protected:
+				// Lifted action, every required (or forbidden) atom keeps for each argument the parameter it takes; the first
+				// fixed required atoms are static
+				class Schema{
+					public:
+						const PDDL::Domain::Action* action;
+						Expressions::Expression* precondition;
+						Expressions::Expression* effect;
+						std::vector<Expressions::idexpr_t> parameters;
+						std::vector<std::set<Expressions::idexpr_t>> objects;
+						std::vector<Expressions::Arguments> required;
+						std::vector<std::vector<int>> slots;
+						size_t fixed;
+						std::vector<Expressions::Arguments> forbidden;
+						std::vector<std::vector<int>> forbiddenSlots;
+						std::vector<unsigned int> free;
+						Schema() : action(0), precondition(0), effect(0), fixed(0) {};
+				};
+				// Reachable atoms with the round that reached them, in the order they were reached
+				using Entries = std::vector<std::pair<const Expressions::Atom*,unsigned int>>;
+				// Atoms of a predicate with the value at the position, position 0 keeps every atom of the predicate
+				class Key{
+					public:
+						Expressions::idexpr_t predicate;
+						Expressions::idexpr_t value;
+						size_t position;
+						inline bool operator==(const Key &other) const { return predicate == other.predicate && value == other.value && position == other.position; }
+				};
+				class KeyHash{
+					public:
+						inline size_t operator()(const Key &key) const {
+							uint64_t h = ((key.predicate<<8) ^ key.position) * 0x9E3779B97F4A7C15ULL ^ key.value;
+							h *= 0xBF58476D1CE4E5B9ULL;
+							return h ^ (h>>31);
+						}
+				};
+				std::unordered_map<Key,Entries,KeyHash> index;
+				std::vector<bool> joined;
+				Expressions::Atoms known;
+				std::vector<Expressions::idexpr_t> pending;
+				std::vector<Expressions::idexpr_t> binding;
+				std::map<Expressions::idexpr_t,std::string> names;
+				// Initial atoms, with the arguments of the static ones
+				Expressions::Atoms atoms;
+				std::set<Expressions::Arguments> statics;
+				std::vector<int> slots(const Schema &schema,const Expressions::ArgumentSpan &args) const;
+				bool allowed(const Schema &schema) const;
+				void reach(const Expressions::Atom* atom,unsigned int round);
+				bool candidates(const Schema &schema,size_t atom,size_t pivot,unsigned int round,const Entries* &entries,size_t &first,size_t &last) const;
+				void match(const Schema &schema,size_t depth,size_t pivot,unsigned int round,std::vector<Action> &actions);
+				void instantiate(const Schema &schema,size_t parameter,std::vector<Action> &actions);
+			public:
+				// Rounds: Number of rounds the fixpoint took
+				// Fluents: Predicates some effect adds or deletes, the others are static
+				unsigned int rounds;
+				std::set<Expressions::idexpr_t> fluents;
+				void ground(const PDDL::Domain* domain,const PDDL::Problem* problem,const Expressions::World* initial,std::vector<Action> &actions);
+		};
+		// Decision tree over the facts of the compiled preconditions, yields the actions whose preconditions can hold in a world
+		// Every node tests one fact and has a child for the actions requiring it, one for those requiring its absence and one
+		// for those that don't mention it; actions that can't be compiled are always yielded and must still be tested
+		class SuccessorGenerator{
+			protected:
+				class Node{
+					public:
+						Expressions::idfact_t fact;
+						unsigned int present;
+						unsigned int absent;
+						unsigned int any;
+						unsigned int first;
+						unsigned int last;
+						Node() : fact(Expressions::NOFACT), present(0), absent(0), any(0), first(0), last(0) {};
+				};
+				std::vector<Node> nodes;
+				std::vector<unsigned int> leaves;
+				unsigned int build(std::vector<std::pair<unsigned int,unsigned int>> &entries,const std::vector<std::vector<std::pair<Expressions::idfact_t,bool>>> &conditions);
+			public:
+				void build(const std::vector<Action> &actions);
+				unsigned int applicable(const Expressions::World* world,std::vector<unsigned int> &result) const;
+		};
+		// Preconditions of STRIPS actions as required-true and required-false masks over the words of the world, tested for
+		// LANES actions at a time (with AVX2 when the processor has it); an action keeps one slot per word its precondition reads
+		class ApplicabilityMasks{
+			protected:
+				std::vector<unsigned int> blocks;
+				std::vector<unsigned int> lanes;
+				std::vector<int32_t> words;
+				std::vector<uint64_t> positive;
+				std::vector<uint64_t> negative;
+				size_t width;
+				void scalarKernel(const uint64_t* buffer,std::vector<unsigned int> &result) const;
+#if defined(PLANNER_AVX2)
+				__attribute__((target("avx2"))) void avx2Kernel(const uint64_t* buffer,std::vector<unsigned int> &result) const;
+#endif
+			public:
+				static const unsigned int LANES = 4;
+				// Usable: Every precondition could be compiled and testing the masks is cheaper than the successor generator
+				// Vectorized: Test the blocks with the AVX2 kernel, build sets it when the processor supports it
+				bool usable;
+				bool vectorized;
+				static bool supportsAVX2();
+				ApplicabilityMasks() : width(0), usable(false), vectorized(false) {};
+				void build(const std::vector<Action> &actions);
+				void applicable(const Expressions::World* world,std::vector<unsigned int> &result) const;
+				inline size_t slots() const { return words.size()/LANES; }
 		};
+		// World of the search with the planner it belongs to, the worker threads take the context of the planner from it
 		class WorldState{
 			public:
-				static std::vector<Action> actions;
-				static Expressions::Expression* goal;
+				DoradoPlanner* planner;
 				Expressions::World* world;
 				WorldState();
-				WorldState(Expressions::World* w);
+				WorldState(DoradoPlanner* p,Expressions::World* w);
 				~WorldState();
 				AStar::idstate_t getKey();
 				AStar::NodeNeighbors<WorldState> getNeighbors();
+				void releaseNeighbors();
 				static bool goalFunction(const WorldState& state);
 		};
 	protected:
-		std::vector<std::vector<std::pair<std::string,std::string>>> possibleParameters(PDDL::Problem* problem, const std::vector<std::pair<std::string,std::string>> &params, int curr=0);
-		PDDL::Domain* domain;
+		// Held while the planner lives, releasing the parsed PDDL on another thread doesn't free it
+		std::shared_ptr<PDDL::Domain> domain;
+		// Expressions, words and worlds of the problems planned, selected by every thread working for this planner
+		Expressions::Context context;
+		std::map<AStar::idaction_t,std::string> mapActions;
+		std::vector<Action> actions;
+		SuccessorGenerator generator;
+		ApplicabilityMasks masks;
+		Expressions::Expression* goal;
+		Expressions::CompiledAction compiledGoal;
+		Expressions::WorldRegistry* registry;
+		// The search drops the successors of a world in the reverse order it generates them (IDA*), they are registered in a
+		// scope of the registry and released with it
+		bool scoped;
 	public:
+		// Store the worlds as deltas from their parent with a full snapshot every snapshotInterval levels (0 keeps full worlds),
+		// trades rebuilding the expanded worlds for memory on large problems; the search then runs on a single thread
+		unsigned int snapshotInterval;
+		// Store the worlds packed in a finite domain encoding over the mutex groups found in the grounded actions, trades
+		// unpacking the expanded worlds for memory; the search then runs on a single thread
+		bool finiteDomain;
+		// Grounding of the last plan: time taken (ms) and number of actions kept for the search
+		double groundingTime;
+		size_t groundedActions;
+		// Names of the actions leading to the state nearest to the goal, when the last plan stopped without a solution and
+		// metrics were requested
+		std::vector<std::string> partialPlan;
 		DoradoPlanner(const std::string filename);
-		std::vector<std::string> plan(const std::string filename,AStar::AStarMetrics *mets=0);
+		std::vector<std::string> plan(const std::string filename,AStar::AStarMetrics *mets=0,const AStar::AStarParameters *params=0);
+		// Name of a grounded action of the last plan, for the actions the solution function of the parameters reports
+		const std::string& actionName(AStar::idaction_t action) const;
 };
 
 #endif
@@ -56,6 +56,97 @@ bool solved(const RiverState& s){
 	return s.human && s.wolf && s.sheep && s.vegetable;
 }
 
+double remaining(const RiverState& s){
+	return !s.human + !s.wolf + !s.sheep + !s.vegetable;
+}
+
+void improved(const AStar::Path<RiverState>& path,double bound){
+	cout<<"Anytime solution size: "<<path.size()<<"\tBound: "<<bound<<std::endl;
+}
+
+// Chain of states with integral but widely spread costs, a few open nodes would need tens of thousands of buckets
+class SpreadState{
+	public:
+		unsigned int position;
+		SpreadState(unsigned int p=0) : position(p) {};
+		AStar::NodeNeighbors<SpreadState> getNeighbors(){
+			AStar::NodeNeighbors<SpreadState> neighbors;
+			if(position < 3){ neighbors.push_back({SpreadState(position+1),20000.0,position+1}); }
+			return neighbors;
+		}
+		AStar::idstate_t getKey(){ return position; }
+};
+
+int passes = 0;
+int tests = 0;
+
+// Replays the path through getNeighbors: every step must be a neighbor of the previous one, reached by its action
+bool validPath(const RiverState& initialState,const AStar::Path<RiverState>& path,bool complete = true){
+	if(path.empty()){ return !complete; }
+	RiverState state = path[0].second;
+	if(state.getKey()!=RiverState(initialState).getKey()){ return false; }
+	for(size_t i=1;i<path.size();i++){
+		RiverState next = path[i].second;
+		bool found = false;
+		for(AStar::Edge<RiverState>& edge : state.getNeighbors()){
+			if(edge.action==path[i].first && edge.state.getIdentifier()==next.getKey()){ found = true; break; }
+		}
+		if(!found){ return false; }
+		state = next;
+	}
+	return !complete || solved(state);
+}
+
+// Replays the actions of a partial path from the initial state
+bool validActions(const RiverState& initialState,const std::vector<AStar::idaction_t>& actions){
+	RiverState state = initialState;
+	for(AStar::idaction_t action : actions){
+		bool found = false;
+		for(AStar::Edge<RiverState>& edge : state.getNeighbors()){
+			if(edge.action==action){ state = edge.state.getState(); found = true; break; }
+		}
+		if(!found){ return false; }
+	}
+	return true;
+}
+
+void run_test_limit(const char* testName,unsigned int strategy,unsigned long long int nodeLimit){
+	AStar::AStarParameters parameters;
+	AStar::AStarMetrics metrics;
+	parameters.strategy = strategy;
+	parameters.nodeLimit = nodeLimit;
+	RiverState initState;
+	AStar::Path<RiverState> solution = AStar::Search(initState,solved,remaining,&metrics,&parameters);
+	bool result = metrics.termination==AStar::Termination::NODE_LIMIT && (solution.empty()?!metrics.partialActions.empty() && validActions(initState,metrics.partialActions):validPath(initState,solution));
+	cout<<"Test "<<testName<<" ("<<AStar::SearchStrategy::names[strategy]<<"): "<<(result?"PASSED":"FAILED")<<"\tsize: "<<solution.size()<<"\tpartial: "<<metrics.partialActions.size()<<std::endl;
+	tests++;
+	if(result){ passes++; }
+}
+
+// The frontier must leave the buckets when they outgrow the open nodes, and keep them otherwise
+void run_test_buckets(){
+	AStar::AStarMetrics metrics;
+	AStar::Path<SpreadState> spread = AStar::Search(SpreadState(),[](const SpreadState& s){ return s.position == 3; },[](const SpreadState& s){ return 20000.0*(3-s.position); },&metrics);
+	bool result = spread.size()==4 && !metrics.bucketQueue;
+	AStar::Search(RiverState(),solved,remaining,&metrics);
+	result = result && metrics.bucketQueue;
+	cout<<"Test bucket spread: "<<(result?"PASSED":"FAILED")<<std::endl;
+	tests++;
+	if(result){ passes++; }
+}
+
+void run_test(const char* testName,unsigned int strategy,size_t size){
+	AStar::AStarParameters parameters;
+	AStar::AStarMetrics metrics;
+	parameters.strategy = strategy;
+	RiverState initState;
+	AStar::Path<RiverState> solution = AStar::Search(initState,solved,remaining,&metrics,&parameters);
+	bool result = (size==0 || solution.size()==size) && metrics.termination==AStar::Termination::SOLVED && validPath(initState,solution);
+	cout<<"Test "<<testName<<" ("<<AStar::SearchStrategy::names[strategy]<<"): "<<(result?"PASSED":"FAILED")<<"\tsize: "<<solution.size()<<std::endl;
+	tests++;
+	if(result){ passes++; }
+}
+
 int main(){
 	
 	RiverState initState;
@@ -73,6 +164,31 @@ int main(){
 		}
 	}
 	
+	AStar::AStarParameters parameters;
+	AStar::AStarMetrics metrics;
+	parameters.weight = 3.0;
+	AStar::Path<RiverState> solution = AStar::AnytimeAStar(initState,solved,remaining,improved,&metrics,&parameters);
+	cout<<"Anytime final size: "<<solution.size()<<std::endl<<metrics;
+	
+	// Heuristic carrying its own goal
+	RiverState goalState(true,true,true,true);
+	auto misplaced = [goalState](const RiverState& s){
+		return (double)((s.human!=goalState.human) + (s.wolf!=goalState.wolf) + (s.sheep!=goalState.sheep) + (s.vegetable!=goalState.vegetable));
+	};
+	solution = AStar::Search(initState,solved,misplaced,&metrics);
+	cout<<"Functor solution size: "<<solution.size()<<std::endl;
+	
+	// A size of 0 accepts any valid plan, for the searches that aren't optimal
+	run_test("river",AStar::SearchStrategy::ASTAR,8);
+	run_test("river",AStar::SearchStrategy::ANYTIME,8);
+	run_test("river",AStar::SearchStrategy::GREEDY,0);
+	run_test("river",AStar::SearchStrategy::IDASTAR,8);
+	run_test("river",AStar::SearchStrategy::HDASTAR,8);
+	run_test_limit("river node limit",AStar::SearchStrategy::ASTAR,4);
+	run_test_limit("river node limit",AStar::SearchStrategy::IDASTAR,10);
+	run_test_buckets();
+	cout<<"Passed: "<<passes<<"/"<<tests<<std::endl;
+	
 	cout << "Type and press ENTER...";
 	char c;
 	std::cin>>c;
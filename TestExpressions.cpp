@@ -1,5 +1,6 @@
 #include "Expressions.cpp"
 #include <stdio.h>
+#include <thread>
 
 using Expressions::World;
 using Expressions::Expression;
@@ -21,6 +22,8 @@ void run_test_simple(const char* testName, std::set<std::string> atoms,std::stri
 	World* world = make_world(atoms,sets);
 	Expression* expr = make_expression(expression);
 	bool result = expr->isModeledBy(world);
+	// Expanding the quantifiers must not change the result
+	if(expr->ground()->isModeledBy(world)!=result){ result = !expectedResult; }
 	if(!leakTest){ std::cout<<"Test "<<testName<<": "<<(result==expectedResult?"PASSED":"FAILED")<<std::endl; }
 	tests++;
 	if(result==expectedResult){ passed++; }
@@ -61,9 +64,19 @@ void run_test_executeplan(const char* testName, std::set<std::string> atoms, std
 			result = false;
 			break;
 		}
+		World* newWorld = world->apply(effexp);
+		// The grounded and compiled actions must agree with the expressions
+		if(!preexp->ground()->isModeledBy(world) || world->apply(effexp->ground())!=newWorld){
+			result = false;
+			break;
+		}
+		Expressions::CompiledAction compiled(preexp,effexp);
+		if((compiled.flatPrecondition && !compiled.isModeledBy(world)) || (compiled.flatEffect && world->apply(compiled)!=newWorld)){
+			result = false;
+			break;
+		}
 		tests++;
 		passed++;
-		World* newWorld = world->apply(effexp);
 		world = newWorld;
 	}
 	tests++;
@@ -90,6 +103,7 @@ int main(){
 	run_test_simple("simple AND", atoms, "(and (not (on a b)) (on a c))", false);
 	run_test_simple("simple OR", atoms, "(or (on a b) (on a d))", true);
 	run_test_simple("simple NOT", atoms, "(not (on a b))", false);
+	run_test_simple("simple single AND", atoms, "(and (on a b))", true);
 	run_test_simple("simple IMPLY", atoms, "(imply (on a b) (on b a))", false);
 	run_test_simple("simple EXISTS", atoms, "(exists (?v - ) (on a ?v))", true, { {"", {"a", "b", "c"}} });
 	run_test_simple("simple FORALL", atoms, "(forall (?v - restricted) (on ?v b))", true, { {"", {"a", "b", "c"}}, {"restricted", {"a"}} });
@@ -231,14 +245,82 @@ int main(){
     sets = {{"trucks", {"truck1", "truck2"}}, {"truckarea", {"a1", "a2"}}, {"", {"a1", "a2", "truck1", "truck2"}}};
 	goal = "(and (at package1 l1) (at package2 l3))";
 	
-	run_test_executeplan("execute plan truck",atoms, 
-					{{pdrive,edrive,{{"?t", "truck1"}, {"?from", "l3"}, {"?to", "l2"}}},
+	std::vector<Action> truckPlan = {{pdrive,edrive,{{"?t", "truck1"}, {"?from", "l3"}, {"?to", "l2"}}},
                       {pload,eload,{{"?t", "truck1"}, {"?l", "l2"}, {"?p", "package1"}, {"?a1", "a2"}}},
                       {pload,eload,{{"?t", "truck1"}, {"?l", "l2"}, {"?p", "package2"}, {"?a1", "a1"}}},
                       {pdrive,edrive,{{"?t", "truck1"}, {"?from", "l2"}, {"?to", "l3"}}},
                       {punload,eunload,{{"?t", "truck1"}, {"?l", "l3"}, {"?p", "package2"}, {"?a1", "a1"}}},
                       {pdrive,edrive,{{"?t", "truck1"}, {"?from", "l3"}, {"?to", "l1"}}},
-                      {punload,eunload,{{"?t", "truck1"}, {"?l", "l1"}, {"?p", "package1"}, {"?a1", "a2"}}}}, goal, true, sets);
+                      {punload,eunload,{{"?t", "truck1"}, {"?l", "l1"}, {"?p", "package1"}, {"?a1", "a2"}}}};
+	run_test_executeplan("execute plan truck",atoms,truckPlan, goal, true, sets);
+	{
+		// Same plan over worlds stored as deltas, with a snapshot every 2 levels
+		Expressions::WorldRegistry deltas(2);
+		Expressions::use_registry(&deltas);
+		run_test_executeplan("execute plan truck deltas",atoms,truckPlan, goal, true, sets);
+		Expressions::use_registry(0);
+	}
+	{
+		// Driving keeps the truck at one location, the same plan then runs over worlds packed in the finite domain
+		std::vector<Expressions::CompiledAction> drives;
+		std::vector<std::pair<const Expressions::CompiledAction*,Expression*>> grounded;
+		for(std::string from : {"l1","l2","l3"}){
+			for(std::string to : {"l1","l2","l3"}){
+				Expression* preexp = make_expression(pdrive);
+				Expression* effexp = make_expression(edrive);
+				for(std::pair<std::string,std::string> par : std::vector<std::pair<std::string,std::string>>{{"?t","truck1"},{"?from",from},{"?to",to}}){
+					preexp = preexp->substitute(get_idword(par.first),get_idword(par.second));
+					effexp = effexp->substitute(get_idword(par.first),get_idword(par.second));
+				}
+				drives.push_back(Expressions::CompiledAction(preexp,effexp));
+			}
+		}
+		for(const Expressions::CompiledAction &drive : drives){ grounded.push_back({&drive,0}); }
+		std::vector<Expressions::Facts> groups = Expressions::mutex_groups(make_world(atoms,sets),grounded);
+		Expressions::Facts truckAt;
+		for(std::string l : {"l1","l2","l3"}){ truckAt.push_back(static_cast<Expressions::Atom*>(make_expression("(at truck1 "+l+")"))->fact); }
+		std::sort(truckAt.begin(),truckAt.end());
+		bool found = false;
+		for(Expressions::Facts group : groups){
+			std::sort(group.begin(),group.end());
+			found = found || group==truckAt;
+		}
+		if(!leakTest){ std::cout<<"Test mutex groups truck: "<<(found?"PASSED":"FAILED")<<std::endl; }
+		tests++;
+		if(found){ passed++; }
+		Expressions::FiniteDomain encoding(groups);
+		Expressions::WorldRegistry packed;
+		packed.encode(&encoding);
+		Expressions::use_registry(&packed);
+		run_test_executeplan("execute plan truck packed",atoms,truckPlan, goal, true, sets);
+		Expressions::use_registry(0);
+	}
+	{
+		// Same plan on another thread with a context of its own, the expressions of this context stay as they were
+		idexpr_t key = make_expression("(at truck1 l1)")->key;
+		std::thread planner([&](){
+			Expressions::Context context;
+			Expressions::use_context(&context);
+			run_test_executeplan("execute plan truck context",atoms,truckPlan, goal, true, sets);
+			Expressions::use_context(0);
+		});
+		planner.join();
+		bool kept = make_expression("(at truck1 l1)")->key==key;
+		if(!leakTest){ std::cout<<"Test context kept: "<<(kept?"PASSED":"FAILED")<<std::endl; }
+		tests++;
+		if(kept){ passed++; }
+	}
+	{
+		// Static atoms take their initial value, the fluent ones are kept
+		std::set<idexpr_t> fluents{get_idword("on")};
+		Expressions::Atoms initial{make_expression("(road a b)")->key};
+		Expression* kept = make_expression("(and (on a b) (road a b) (not (road b a)))")->simplify(fluents,initial);
+		Expression* decided = make_expression("(or (on a b) (not (road a b)) (road a b))")->simplify(fluents,initial);
+		bool simplified = kept==make_expression("(and (on a b))") && decided->isModeledBy(make_world({},{})) && !make_expression("(and (on a b) (road b a))")->simplify(fluents,initial)->isModeledBy(make_world({"(on a b)"},{}));
+		if(!leakTest){ std::cout<<"Test simplify static: "<<(simplified?"PASSED":"FAILED")<<std::endl; }
+		tests++;
+		if(simplified){ passed++; }
+	}
 	
 	if(passed!=tests){ error("Failed plan execution tests"); goto end; }
 	
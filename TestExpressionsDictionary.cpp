@@ -4,6 +4,7 @@
 #include <iostream>
 using namespace std;
 #include <stdio.h>
+#include <chrono>
 
 using namespace ExpressionsDictionary;
 
@@ -32,14 +33,25 @@ int main(){
 	cout<<"Insert "<<x[0]<<": "<<t2[x]<<endl;
 	cout<<"Insert "<<z[0]<<": "<<t2[z]<<endl;
 	
+	auto tStart = std::chrono::steady_clock::now();
 	for(int i=0;i<1000;i++){
 		for(int j=0;j<1000;j++){
 			x = {i,j};
 			t2[x];
 		}
 	}
+	double insertMs = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - tStart).count();
+	tStart = std::chrono::steady_clock::now();
+	unsigned int checksum = 0;
+	for(int i=0;i<1000;i++){
+		for(int j=0;j<1000;j++){
+			x = {i,j};
+			checksum ^= t2[x];
+		}
+	}
+	double lookupMs = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - tStart).count();
 	
-	std::cout<<"Size: "<<t2.size()<<std::endl;
+	std::cout<<"Size: "<<t2.size()<<"\tinsert: "<<insertMs<<" ms\tlookup: "<<lookupMs<<" ms ("<<checksum<<")"<<std::endl;
 	printf("Press ENTER...");
 	fgetc(stdin);
 	t2.clear();
@@ -11,11 +11,11 @@ int main(){
 	
 	for(int i=0;i<(leakTest?100000:1);i++){
 	
-	Domain* domain = parsePDDLDomain("test_domains/elevator_adl_domain.pddl");
+	std::shared_ptr<Domain> domain = parsePDDLDomain("test_domains/elevator_adl_domain.pddl");
 	if(!leakTest){ cout<<*domain<<std::endl; } 
 	domain = parsePDDLDomain("test_domains/elevator_adl_domain.pddl");
 	if(!leakTest){ cout<<*domain<<std::endl; } 
-	Problem* problem = parsePDDLProblem("test_domains/elevator_adl_problem1.pddl");
+	std::shared_ptr<Problem> problem = parsePDDLProblem("test_domains/elevator_adl_problem1.pddl");
 	if(!leakTest){ cout<<*problem<<std::endl; } 
 	problem = parsePDDLProblem("test_domains/elevator_adl_problem1.pddl");
 	if(!leakTest){ cout<<*problem<<std::endl; } 
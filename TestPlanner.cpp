@@ -5,6 +5,9 @@
 #include <chrono>
 #include <iomanip>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
 using std::cout;
 using std::endl;
 
@@ -15,29 +18,270 @@ int tests = 0;
 
 bool leakTest=false;
 
+AStar::AStarParameters parameters;
+
 void performTest(const char* testName, const char* domain, const char* problem){
 	AStar::AStarMetrics metrics;
 	auto tStart = std::chrono::steady_clock::now();
 	DoradoPlanner dpl(domain);
-	std::vector<std::string> res = dpl.plan(problem,&metrics);
+	std::vector<std::string> res = dpl.plan(problem,&metrics,&parameters);
 	double timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
 	if(!leakTest){ 
 		std::cout<<"Test "<<testName<<":\t";
 		for(int i=0; i<(25-strlen(testName))/8 ; i++){ cout << "\t"; }
 		std::cout<<(res.size()?"PASSED":"FAILED")<<"\tactions: "<<res.size()
 			<<"\tt-time: "<<std::setprecision(3)<<(timeMs/1000.0)
+			<<"\tGactions: "<<dpl.groundedActions
+			<<"\tg-time: "<<std::setprecision(3)<<(dpl.groundingTime/1000.0)
 			<<"\tFnodes: "<<metrics.frontierNodes
-			<<"\tEnodes: "<<metrics.expandedNodes<<std::endl;
+			<<"\tEnodes: "<<metrics.expandedNodes
+			<<"\tEnded: "<<AStar::Termination::names[metrics.termination]<<std::endl;
 	}
 	totTime += timeMs;
 	Expressions::releaseMemory();
 	PDDL::releaseMemory();
 }
 
+// Replays the plan from the initial world of the problem: every action must hold in the world it is applied to, and the goal
+// must hold at the end unless the plan is only the prefix a stopped search reached
+bool validPlan(const char* domainFile, const char* problemFile, const std::vector<std::string> &plan, bool complete = true){
+	std::shared_ptr<PDDL::Domain> domain = PDDL::parsePDDLDomain(domainFile);
+	std::shared_ptr<PDDL::Problem> problem = PDDL::parsePDDLProblem(problemFile);
+	Expressions::World* world = Expressions::make_world(problem->init,problem->sets);
+	bool valid = true;
+	for(const std::string &step : plan){
+		std::istringstream words(step);
+		std::string name;
+		std::string object;
+		words >> name;
+		const PDDL::Domain::Action* action = 0;
+		for(const PDDL::Domain::Action &act : domain->actions){
+			if(act.name == name){ action = &act; }
+		}
+		if(!action){
+			valid = false;
+			break;
+		}
+		Expressions::Expression* precondition = Expressions::make_expression(action->precondition);
+		Expressions::Expression* effect = Expressions::make_expression(action->effect);
+		for(const std::pair<std::string,std::string> &param : action->parameters){
+			words >> object;
+			precondition = precondition->substitute(Expressions::get_idword(param.first),Expressions::get_idword(object));
+			effect = effect->substitute(Expressions::get_idword(param.first),Expressions::get_idword(object));
+		}
+		if(!precondition->isModeledBy(world)){
+			valid = false;
+			break;
+		}
+		world = world->apply(effect);
+	}
+	if(valid && complete){ valid = Expressions::make_expression(problem->goal)->isModeledBy(world); }
+	Expressions::releaseMemory();
+	return valid;
+}
+
+// Greedy best first search doesn't bound the length of its plan, the plan must be valid
+void run_test_greedy(const char* testName, const char* domain, const char* problem){
+	AStar::AStarParameters params;
+	params.strategy = AStar::SearchStrategy::GREEDY;
+	AStar::AStarMetrics metrics;
+	std::vector<std::string> res;
+	{
+		DoradoPlanner dpl(domain);
+		res = dpl.plan(problem,&metrics,&params);
+	}
+	bool result = !res.empty() && metrics.termination == AStar::Termination::SOLVED && validPlan(domain,problem,res);
+	if(!leakTest){ std::cout<<"Test "<<testName<<": "<<(result?"PASSED":"FAILED")<<"\tactions: "<<res.size()<<std::endl; }
+	tests++;
+	if(result){ passes++; }
+}
+
+// The strategy must return a valid plan of the optimal length
+void run_test_optimal(const char* testName, unsigned int strategy, const char* domain, const char* problem, size_t length){
+	AStar::AStarParameters params;
+	params.strategy = strategy;
+	params.weight = strategy==AStar::SearchStrategy::ANYTIME?3.0:1.0;
+	params.threads = 4;
+	AStar::AStarMetrics metrics;
+	std::vector<std::string> res;
+	{
+		DoradoPlanner dpl(domain);
+		res = dpl.plan(problem,&metrics,&params);
+	}
+	bool result = res.size()==length && metrics.termination == AStar::Termination::SOLVED && validPlan(domain,problem,res);
+	if(!leakTest){ std::cout<<"Test "<<testName<<" ("<<AStar::SearchStrategy::names[strategy]<<"): "<<(result?"PASSED":"FAILED")<<"\tactions: "<<res.size()<<"/"<<length<<std::endl; }
+	tests++;
+	if(result){ passes++; }
+}
+
+// A limited search passes when it reports the limit and returns either a valid plan (the incumbent) or a valid prefix
+void run_test_limit(const char* testName, unsigned int strategy, const char* domain, const char* problem, unsigned long long int nodeLimit, double timeLimit, unsigned int termination){
+	AStar::AStarParameters params;
+	params.strategy = strategy;
+	params.threads = 4;
+	params.nodeLimit = nodeLimit;
+	params.timeLimit = timeLimit;
+	AStar::AStarMetrics metrics;
+	std::vector<std::string> res;
+	std::vector<std::string> partial;
+	{
+		DoradoPlanner dpl(domain);
+		res = dpl.plan(problem,&metrics,&params);
+		partial = dpl.partialPlan;
+	}
+	bool result = metrics.termination == termination && (res.empty()?!partial.empty() && validPlan(domain,problem,partial,false):validPlan(domain,problem,res));
+	if(!leakTest){ std::cout<<"Test "<<testName<<" ("<<AStar::SearchStrategy::names[strategy]<<"): "<<(result?"PASSED":"FAILED")<<"\ttermination: "<<AStar::Termination::names[metrics.termination]<<"\tactions: "<<res.size()<<"\tpartial: "<<partial.size()<<std::endl; }
+	tests++;
+	if(result){ passes++; }
+}
+
+// Raises the node limit until the anytime search completes, some run in between must stop with its first solution
+void run_test_incumbent(const char* testName, const char* domain, const char* problem){
+	AStar::AStarParameters params;
+	params.strategy = AStar::SearchStrategy::ANYTIME;
+	params.weight = 5.0;
+	params.weightDecrement = 1.0;
+	AStar::AStarMetrics metrics;
+	bool result = false;
+	unsigned long long int limit = 1;
+	do{
+		params.nodeLimit = limit;
+		std::vector<std::string> res;
+		{
+			DoradoPlanner dpl(domain);
+			res = dpl.plan(problem,&metrics,&params);
+		}
+		if(metrics.termination == AStar::Termination::NODE_LIMIT && !res.empty()){
+			result = validPlan(domain,problem,res);
+			if(!leakTest){ std::cout<<"Test "<<testName<<": "<<(result?"PASSED":"FAILED")<<"\tnode limit: "<<limit<<"\tactions: "<<res.size()<<std::endl; }
+			break;
+		}
+		limit += limit/2+1;
+	}while(metrics.termination == AStar::Termination::NODE_LIMIT);
+	if(!leakTest && metrics.termination != AStar::Termination::NODE_LIMIT){ std::cout<<"Test "<<testName<<": FAILED\tno incumbent before "<<limit<<" nodes"<<std::endl; }
+	tests++;
+	if(result){ passes++; }
+}
+
+// Both kernels of the applicability masks must yield the actions whose compiled precondition holds, on worlds of several
+// words and on worlds trimmed to their first one
+void masksTest(const char* testName){
+	const int FACTS = 200;
+	Expressions::Context context;
+	Expressions::Context* previousContext = Expressions::use_context(&context);
+	std::mt19937 random(14);
+	std::vector<Expressions::idexpr_t> keys;
+	for(int i = 0; i < FACTS; i++){ keys.push_back(Expressions::make_expression("(f o"+std::to_string(i)+")")->key); }
+	Expressions::index_facts(Expressions::Atoms(keys.begin(),keys.end()));
+	// The first action has no precondition and the last one a false equality, the count leaves a block with empty lanes
+	std::vector<DoradoPlanner::Action> actions;
+	for(unsigned int a = 0; a < 37; a++){
+		std::string precondition = "(and";
+		for(unsigned int literal = a?random()%6:0; literal > 0; literal--){
+			std::string atom = "(f o"+std::to_string(random()%FACTS)+")";
+			precondition += random()%3?" "+atom:" (not "+atom+")";
+		}
+		if(a == 36){ precondition += " (= o1 o2)"; }
+		precondition += ")";
+		Expressions::Expression* expr = Expressions::make_expression(precondition);
+		actions.emplace_back("a"+std::to_string(a),expr,(Expressions::Expression*)0,a+1);
+		actions.back().compiled = Expressions::CompiledAction(expr,0);
+	}
+	DoradoPlanner::ApplicabilityMasks masks;
+	masks.build(actions);
+	bool vectorized = masks.vectorized;
+	bool passed = masks.usable;
+	size_t applicable = 0;
+	std::vector<unsigned int> expected;
+	std::vector<unsigned int> result;
+	for(int w = 0; w < 1000 && passed; w++){
+		Expressions::Atoms atoms;
+		for(int i = 0; i < (w%2?FACTS:64); i++){
+			if((int)(random()%8) <= w%7){ atoms.insert(keys[i]); }
+		}
+		Expressions::World* world = Expressions::make_world(atoms);
+		expected.clear();
+		for(unsigned int a = 0; a < actions.size(); a++){
+			if(actions[a].compiled.isModeledBy(world)){ expected.push_back(a); }
+		}
+		applicable += expected.size();
+		masks.vectorized = false;
+		masks.applicable(world,result);
+		passed = result == expected;
+		if(vectorized){
+			masks.vectorized = true;
+			masks.applicable(world,result);
+			passed = passed && result == expected;
+		}
+	}
+	Expressions::use_context(previousContext);
+	tests++;
+	passes += passed;
+	std::cout<<"Test "<<testName<<":\t"<<(passed?"PASSED":"FAILED")<<"\tkernels: "<<(vectorized?"scalar and AVX2":"scalar (no AVX2)")<<"\tapplicable: "<<applicable<<std::endl;
+}
+
+// Two planners on their own threads while a third keeps releasing the parsed PDDL, both must find the same plan
+void concurrencyTest(const char* testName, const char* domain, const char* problem){
+	std::atomic<bool> planning(true);
+	std::vector<std::string> res[2];
+	auto planner = [&](int i){
+		DoradoPlanner dpl(domain);
+		res[i] = dpl.plan(problem);
+	};
+	std::thread releaser([&](){
+		while(planning.load()){
+			PDDL::releaseMemory();
+			std::this_thread::yield();
+		}
+	});
+	std::thread first(planner,0);
+	std::thread second(planner,1);
+	first.join();
+	second.join();
+	planning.store(false);
+	releaser.join();
+	bool passed = !res[0].empty() && res[0] == res[1] && validPlan(domain,problem,res[0]);
+	tests++;
+	passes += passed;
+	std::cout<<"Test "<<testName<<":\t"<<(passed?"PASSED":"FAILED")<<"\tactions: "<<res[0].size()<<" / "<<res[1].size()<<std::endl;
+	PDDL::releaseMemory();
+}
+
 int main(){
 	
+	parameters.strategy = AStar::SearchStrategy::ASTAR;
+	parameters.tieBreaking = AStar::TieBreaking::LOWEST_H;
+	std::cout<<"Search: "<<AStar::SearchStrategy::names[parameters.strategy]<<"\tTie breaking: "<<AStar::TieBreaking::names[parameters.tieBreaking]<<std::endl;
+	
 	for(int i=0;i<(leakTest?100:1);i++){
 	
+	masksTest("applicability masks");
+	concurrencyTest("concurrent logistics","test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl");
+	concurrencyTest("concurrent briefcase","test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl");
+	run_test_greedy("greedy logistics","test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl");
+	run_test_greedy("greedy briefcase","test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl");
+	run_test_greedy("greedy gripper","test_domains/gripper_strips_domain.pddl","test_domains/gripper_strips_problem1.pddl");
+	run_test_optimal("optimal logistics",AStar::SearchStrategy::ASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",14);
+	run_test_optimal("optimal briefcase",AStar::SearchStrategy::ASTAR,"test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl",10);
+	run_test_optimal("optimal gripper",AStar::SearchStrategy::ASTAR,"test_domains/gripper_strips_domain.pddl","test_domains/gripper_strips_problem1.pddl",13);
+	run_test_optimal("optimal logistics",AStar::SearchStrategy::ANYTIME,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",14);
+	run_test_optimal("optimal briefcase",AStar::SearchStrategy::ANYTIME,"test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl",10);
+	run_test_optimal("optimal gripper",AStar::SearchStrategy::ANYTIME,"test_domains/gripper_strips_domain.pddl","test_domains/gripper_strips_problem1.pddl",13);
+	run_test_optimal("optimal logistics",AStar::SearchStrategy::IDASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",14);
+	run_test_optimal("optimal briefcase",AStar::SearchStrategy::IDASTAR,"test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl",10);
+	run_test_optimal("optimal gripper",AStar::SearchStrategy::IDASTAR,"test_domains/gripper_strips_domain.pddl","test_domains/gripper_strips_problem1.pddl",13);
+	run_test_optimal("optimal logistics",AStar::SearchStrategy::HDASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",14);
+	run_test_optimal("optimal briefcase",AStar::SearchStrategy::HDASTAR,"test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl",10);
+	run_test_optimal("optimal gripper",AStar::SearchStrategy::HDASTAR,"test_domains/gripper_strips_domain.pddl","test_domains/gripper_strips_problem1.pddl",13);
+	run_test_limit("node limit logistics",AStar::SearchStrategy::ASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",20,0,AStar::Termination::NODE_LIMIT);
+	run_test_limit("node limit logistics",AStar::SearchStrategy::GREEDY,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",10,0,AStar::Termination::NODE_LIMIT);
+	run_test_limit("node limit logistics",AStar::SearchStrategy::HDASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",20,0,AStar::Termination::NODE_LIMIT);
+	run_test_limit("node limit logistics",AStar::SearchStrategy::IDASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem1.pddl",1000,0,AStar::Termination::NODE_LIMIT);
+	// IDA* gets closer to the goal of this problem with its first expansion but needs seconds to solve it
+	run_test_limit("time limit logistics",AStar::SearchStrategy::IDASTAR,"test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem3.pddl",0,100,AStar::Termination::TIME_LIMIT);
+	run_test_incumbent("incumbent briefcase","test_domains/briefcase_adl_domain.pddl","test_domains/briefcase_adl_problem1.pddl");
+	run_test_incumbent("incumbent logistics","test_domains/logistics_strips_domain.pddl","test_domains/logistics_strips_problem2.pddl");
+	
 	performTest("airport-p04","competition/airport/p04-domain.pddl","competition/airport/p04-airport2-p1.pddl");
 	performTest("airport-p05","competition/airport/p05-domain.pddl","competition/airport/p05-airport2-p1.pddl");
 	performTest("airport-p06","competition/airport/p06-domain.pddl","competition/airport/p06-airport2-p2.pddl");
@@ -75,9 +319,10 @@ int main(){
 	
 	performTest("tpp-p03","competition/tpp/domain.pddl","competition/tpp/p03.pddl");
 	performTest("tpp-p04","competition/tpp/domain.pddl","competition/tpp/p04.pddl");
-
+	
 	}
 	
+	std::cout<<"Passed: "<<passes<<"/"<<tests<<std::endl;
 	std::cout<<"Total time taken: "<<std::setprecision(3)<<(totTime/1000.0)<<" s"<<std::endl;
 	
 	printf("Press ENTER...");